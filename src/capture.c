@@ -0,0 +1,344 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#include "capture.h"
+#include "emulator.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Macro for verbose printing. 0 = no prints, 1 = only info, etc.
+unsigned char capture_verbosity;
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define INFO(...) if(capture_verbosity > 0) printf(__VA_ARGS__)
+#define LOG(...) if(capture_verbosity > 1) printf(__VA_ARGS__)
+
+#define WIDTH (64 * PIXEL_SIZE)
+#define HEIGHT (32 * PIXEL_SIZE)
+
+typedef enum { FORMAT_Y4M, FORMAT_PNG } capture_format;
+
+typedef struct {
+    bool pixels[64 * 32];
+    bool repeat;        // same image as the previous slot; pixels are not filled in
+    unsigned count;     // number of frames this image is shown for
+} capture_slot;
+
+bool capturing;
+capture_format format;
+const char *capture_path;
+FILE *video;
+
+// Ring buffer between capture_frame() and the writer thread.
+capture_slot *queue;
+unsigned queue_head, queue_size;
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t queue_space = PTHREAD_COND_INITIALIZER;
+bool closing;
+bool blocking;              // wait for the writer when the queue is full, rather than dropping the frame
+unsigned long frames_dropped;
+pthread_t writer;
+
+// Image most recently handed to the queue, used to detect unchanged frames.
+bool last_frame[64 * 32];
+bool has_last_frame;
+
+// Writer thread state: the encoded current image, written once per frame.
+byte *encoded;
+unsigned encoded_size;
+unsigned long frames_written;
+bool write_failed;
+
+// Y4M ---------------------------------------------------------------------------------------------------------------
+
+// BT.601 studio-swing conversion of a palette color.
+void rgb_to_ycbcr(byte r, byte g, byte b, byte *yuv) {
+    yuv[0] = (byte)(16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255 + 0.5);
+    yuv[1] = (byte)(128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255 + 0.5);
+    yuv[2] = (byte)(128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255 + 0.5);
+}
+
+void encode_y4m(const bool *pixels) {
+    byte fg[3], bg[3];
+    rgb_to_ycbcr(FG_R, FG_G, FG_B, fg);
+    rgb_to_ycbcr(BG_R, BG_G, BG_B, bg);
+
+    // 4:4:4, one full plane per component
+    const char *marker = "FRAME\n";
+    unsigned plane = WIDTH * HEIGHT;
+    memcpy(encoded, marker, strlen(marker));
+    byte *out = encoded + strlen(marker);
+
+    for(unsigned c = 0; c < 3; ++c)
+        for(unsigned y = 0; y < HEIGHT; ++y)
+            for(unsigned x = 0; x < WIDTH; ++x)
+                *out++ = pixels[(y / PIXEL_SIZE) * 64 + x / PIXEL_SIZE] ? fg[c] : bg[c];
+
+    encoded_size = strlen(marker) + 3 * plane;
+}
+
+// PNG ---------------------------------------------------------------------------------------------------------------
+
+unsigned long png_crc(const byte *data, unsigned length, unsigned long crc) {
+    crc ^= 0xFFFFFFFFUL;
+    for(unsigned i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for(unsigned k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+    }
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+byte *put_u32(byte *out, unsigned long v) {
+    out[0] = v >> 24; out[1] = v >> 16; out[2] = v >> 8; out[3] = v;
+    return out + 4;
+}
+
+// Writes a chunk header; the caller fills in length bytes of data and then calls end_chunk.
+byte *begin_chunk(byte *out, const char *type, unsigned long length) {
+    out = put_u32(out, length);
+    memcpy(out, type, 4);
+    return out + 4;
+}
+
+byte *end_chunk(byte *start, byte *out) {
+    // the crc covers the type and the data
+    return put_u32(out, png_crc(start + 4, out - start - 4, 0));
+}
+
+// 1-bit paletted PNG. The image data is small enough uncompressed that it is stored rather than deflated.
+void encode_png(const bool *pixels) {
+    static const byte signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    unsigned row_size = 1 + (WIDTH + 7) / 8;      // filter byte + packed pixels
+    unsigned raw_size = row_size * HEIGHT;
+    unsigned blocks = (raw_size + 0xFFFE) / 0xFFFF;
+
+    byte *out = encoded;
+    memcpy(out, signature, sizeof(signature));
+    out += sizeof(signature);
+
+    byte *chunk = out;
+    out = begin_chunk(out, "IHDR", 13);
+    out = put_u32(out, WIDTH);
+    out = put_u32(out, HEIGHT);
+    *out++ = 1; *out++ = 3; *out++ = 0; *out++ = 0; *out++ = 0;   // depth, paletted, no interlace
+    out = end_chunk(chunk, out);
+
+    chunk = out;
+    out = begin_chunk(out, "PLTE", 6);
+    *out++ = BG_R; *out++ = BG_G; *out++ = BG_B;
+    *out++ = FG_R; *out++ = FG_G; *out++ = FG_B;
+    out = end_chunk(chunk, out);
+
+    chunk = out;
+    out = begin_chunk(out, "IDAT", 2 + raw_size + 5 * blocks + 4);
+    *out++ = 0x78; *out++ = 0x01;                   // zlib header, no compression
+
+    // build the scanlines in place after each stored block header
+    unsigned long a = 1, b = 0;
+    unsigned remaining = raw_size;
+    unsigned offset = 0;
+    while(remaining > 0) {
+        unsigned length = remaining > 0xFFFF ? 0xFFFF : remaining;
+        remaining -= length;
+        *out++ = remaining == 0;                    // BFINAL, BTYPE = stored
+        *out++ = length; *out++ = length >> 8;
+        *out++ = ~length; *out++ = ~length >> 8;
+
+        for(unsigned i = 0; i < length; ++i, ++offset) {
+            unsigned y = offset / row_size;
+            unsigned column = offset % row_size;
+            byte value = 0;
+            if(column > 0) {
+                for(unsigned bit = 0; bit < 8; ++bit) {
+                    unsigned x = (column - 1) * 8 + bit;
+                    if(x < WIDTH && pixels[(y / PIXEL_SIZE) * 64 + x / PIXEL_SIZE]) value |= 0x80 >> bit;
+                }
+            }
+            *out++ = value;
+            a = (a + value) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    out = put_u32(out, (b << 16) | a);              // adler32
+    out = end_chunk(chunk, out);
+
+    chunk = out;
+    out = begin_chunk(out, "IEND", 0);
+    out = end_chunk(chunk, out);
+
+    encoded_size = out - encoded;
+}
+
+unsigned png_capacity() {
+    unsigned raw_size = (1 + (WIDTH + 7) / 8) * HEIGHT;
+    return 8 + 25 + 18 + 12 + 6 + raw_size + 5 * (raw_size / 0xFFFF + 1) + 12;
+}
+
+// Writer thread -----------------------------------------------------------------------------------------------------
+
+void write_encoded() {
+    if(write_failed) return;
+
+    if(format == FORMAT_Y4M) {
+        if(fwrite(encoded, 1, encoded_size, video) != encoded_size) {
+            ERR("Couldn't write to %s (%s)\n", capture_path, strerror(errno));
+            write_failed = true;
+        }
+    } else {
+        char name[4096];
+        snprintf(name, sizeof(name), capture_path, (unsigned)frames_written);
+        FILE *f = fopen(name, "wb");
+        if(f == NULL || fwrite(encoded, 1, encoded_size, f) != encoded_size) {
+            ERR("Couldn't write %s (%s)\n", name, strerror(errno));
+            write_failed = true;
+        }
+        if(f != NULL) fclose(f);
+    }
+    frames_written++;
+}
+
+void *writer_main(void *arg) {
+    capture_slot slot;
+
+    for(;;) {
+        pthread_mutex_lock(&queue_lock);
+        while(queue_size == 0 && !closing)
+            pthread_cond_wait(&queue_ready, &queue_lock);
+        if(queue_size == 0) {
+            pthread_mutex_unlock(&queue_lock);
+            return NULL;
+        }
+        slot = queue[queue_head];
+        queue_head = (queue_head + 1) % CAPTURE_QUEUE_LENGTH;
+        queue_size--;
+        pthread_cond_signal(&queue_space);
+        pthread_mutex_unlock(&queue_lock);
+
+        // unchanged frames reuse the encoding of the previous image
+        if(!slot.repeat) {
+            if(format == FORMAT_Y4M) encode_y4m(slot.pixels);
+            else encode_png(slot.pixels);
+        }
+        for(unsigned i = 0; i < slot.count; ++i) write_encoded();
+    }
+}
+
+// Public ------------------------------------------------------------------------------------------------------------
+
+bool has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// A png pattern is passed to snprintf, so it must have exactly one unsigned conversion (%u or %d, with an
+// optional 0 flag and a width of up to two digits) and every other % written as %%.
+bool valid_pattern(const char *pattern) {
+    unsigned conversions = 0;
+    for(const char *p = pattern; *p != '\0'; ++p) {
+        if(*p != '%') continue;
+        if(*++p == '%') continue;
+        if(*p == '0') ++p;
+        for(unsigned digits = 0; *p >= '0' && *p <= '9'; ++p)
+            if(++digits > 2) return false;
+        if(*p != 'u' && *p != 'd') return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+int capture_open(const char *path, bool block, unsigned char verbose_lvl) {
+    capture_verbosity = verbose_lvl;
+    capture_path = path;
+    blocking = block;
+
+    if(has_suffix(path, ".y4m")) {
+        format = FORMAT_Y4M;
+        video = fopen(path, "wb");
+        if(video == NULL) {
+            ERR("Couldn't open %s (%s)\n", path, strerror(errno));
+            return 1;
+        }
+        fprintf(video, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n", WIDTH, HEIGHT);
+        encoded = malloc(strlen("FRAME\n") + 3 * WIDTH * HEIGHT);
+    } else if(has_suffix(path, ".png") && valid_pattern(path)) {
+        format = FORMAT_PNG;
+        encoded = malloc(png_capacity());
+    } else {
+        ERR("Unsupported capture format: %s (expected .y4m, or a png pattern with one %%u, like frame%%05u.png)\n",
+            path);
+        return 1;
+    }
+
+    queue = calloc(CAPTURE_QUEUE_LENGTH, sizeof(capture_slot));
+    queue_head = queue_size = 0;
+    closing = false;
+    has_last_frame = false;
+    frames_written = 0;
+    frames_dropped = 0;
+
+    if(pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        ERR("Couldn't start capture writer thread\n");
+        return 1;
+    }
+    capturing = true;
+    INFO("Capturing frames to %s\n", path);
+    return 0;
+}
+
+void capture_frame(const bool *buffer) {
+    if(!capturing) return;
+
+    bool unchanged = has_last_frame && memcmp(buffer, last_frame, sizeof(last_frame)) == 0;
+
+    bool pushed = false;
+
+    pthread_mutex_lock(&queue_lock);
+    if(blocking && !unchanged)
+        while(queue_size == CAPTURE_QUEUE_LENGTH) pthread_cond_wait(&queue_space, &queue_lock);
+    capture_slot *tail = queue_size > 0 ? &queue[(queue_head + queue_size - 1) % CAPTURE_QUEUE_LENGTH] : NULL;
+
+    if(tail != NULL && (unchanged || queue_size == CAPTURE_QUEUE_LENGTH)) {
+        // show the queued image for one more frame; a changed image that didn't fit is lost
+        if(!unchanged) frames_dropped++;
+        tail->count++;
+    } else {
+        capture_slot *slot = &queue[(queue_head + queue_size) % CAPTURE_QUEUE_LENGTH];
+        slot->repeat = unchanged;
+        slot->count = 1;
+        if(!unchanged) memcpy(slot->pixels, buffer, sizeof(slot->pixels));
+        pushed = !unchanged;
+        queue_size++;
+        pthread_cond_signal(&queue_ready);
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    if(pushed) {
+        memcpy(last_frame, buffer, sizeof(last_frame));
+        has_last_frame = true;
+    }
+}
+
+void capture_close() {
+    if(!capturing) return;
+    capturing = false;
+
+    pthread_mutex_lock(&queue_lock);
+    closing = true;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer, NULL);
+
+    if(video != NULL) fclose(video);
+    video = NULL;
+    free(queue);
+    free(encoded);
+    INFO("Captured %lu frames to %s", frames_written, capture_path);
+    if(frames_dropped > 0) INFO(" (%lu changed frames dropped; the writer couldn't keep up)", frames_dropped);
+    INFO("\n");
+}
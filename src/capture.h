@@ -0,0 +1,25 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#ifndef CHIP8_CAPTURE_H
+#define CHIP8_CAPTURE_H
+
+#include <stdbool.h>
+
+// Frames waiting for the writer thread. When full, a blocking capture waits for the writer; otherwise the newest
+// image is dropped (the queued one is shown for another frame) rather than stalling the emulation loop.
+static unsigned const CAPTURE_QUEUE_LENGTH = 64;
+
+// Starts capturing frames to path; either a .y4m video, or a png sequence given as a printf pattern
+// (e.g. frames/%05u.png). Frames are scaled by PIXEL_SIZE and colored with FG_*/BG_*. Blocking captures
+// (headless, where there is no real-time loop to protect) never drop a frame, so they're reproducible.
+int capture_open(const char *path, bool blocking, unsigned char verbose_lvl);
+
+// Queues the screen buffer as the next frame (one per cycle, 60 per second). Does nothing if not capturing.
+void capture_frame(const bool *buffer);
+
+// Writes all queued frames and stops the writer thread.
+void capture_close();
+
+#endif //CHIP8_CAPTURE_H
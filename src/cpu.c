@@ -18,6 +18,7 @@ unsigned char verbosity;
 void initialize_cpu(unsigned char verbose_lvl) {
     verbosity = verbose_lvl;
     cpu.pc.WORD = PROGRAM_START_OFFSET;
+    cpu.rng = 1;
     LOG("pc = 0x%03x\n", PROGRAM_START_OFFSET);
 
     // copy fontset into memory
@@ -28,14 +29,20 @@ void initialize_cpu(unsigned char verbose_lvl) {
     cpu.running = true;
 }
 
-void cpu_process() {
+unsigned cpu_process(unsigned budget) {
     word opcode;
 
+#ifdef CHIP8_AOT
+    unsigned steps = aot_execute(budget);
+    if (steps > 0) return steps;
+#endif
+
     // opcodes are stored in ram as little-endian
     // 4f 13 -> JMP 34f
     opcode.BYTE.high = memory[cpu.pc.WORD];
     opcode.BYTE.low = memory[cpu.pc.WORD+1];
     execute_opcode(opcode);
+    return 1;
 }
 
 
@@ -252,10 +259,14 @@ void jump_offset(word addr) {
     cpu.pc.WORD = cpu.v[0x0] + addr.WORD;
 }
 
+byte random_byte() {
+    cpu.rng = cpu.rng * 1103515245 + 12345;
+    return (cpu.rng >> 16) & 0xFF;
+}
+
 void rnd_reg(byte reg, byte val) {
     VERBOSE("RNG V%x, 0x%02x\n", reg, val);
-    int r = rand() % 256;
-    cpu.v[reg] = r & val;
+    cpu.v[reg] = random_byte() & val;
     cpu.pc.WORD += 2;
 }
 
@@ -25,10 +25,12 @@ typedef struct {
     word stack[16]; // stack allows 16 levels of nested subroutines.
     bool need_repaint; // True if screen needs repainting (updating)
     bool running;   // is the cpu running
+    unsigned rng;   // state of the RND generator, kept here so snapshots replay identically
+    unsigned short keypad;  // keys held this frame, bit k for key k
 } chip8registries;
 
-extern byte memory[4096];   // 4K memory
-extern chip8registries cpu;
+extern __thread byte memory[4096];   // 4K memory, one machine per thread
+extern __thread chip8registries cpu;
 
 static const unsigned PROGRAM_START_OFFSET = 0x200;
 static const unsigned FONTSET_START_OFFSET = 0x000;
@@ -55,10 +57,18 @@ static const byte fontset[80] = {
 
 void initialize_cpu(unsigned char verbose_lvl);
 
-void cpu_process();
+// Executes the instruction(s) at pc, at most budget (at least 1). Returns the number of instructions executed.
+unsigned cpu_process(unsigned budget);
 void execute_opcode(word code);
 
 bool toggle_pixel();
+// Next value of the deterministic generator behind RND.
+byte random_byte();
+
+// Statically recompiled rom (generated by chip8rc), only linked in CHIP8_AOT builds.
+// Runs the basic block at pc and returns its instruction count, or 0 to fall back to the interpreter (also when
+// the block is longer than budget, so frames run exactly as many instructions as when interpreted).
+unsigned aot_execute(unsigned budget);
 
 // instruction set -----------------------------------------------------------------------------------------------------
 void sys_jmp(word addr);                        // 0nnn JMP
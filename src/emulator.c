@@ -3,10 +3,11 @@
 //
 
 #include "emulator.h"
+#include "capture.h"
+#include "telemetry.h"
 
 #include <SDL2/SDL.h>
 #include <stdio.h>
-#include <errno.h>
 
 // Macro for verbose printing. 0 = no prints, 1 = only info, etc.
 unsigned char cpu_verbosity;
@@ -16,13 +17,22 @@ unsigned char cpu_verbosity;
 #define VERBOSE(...) if(cpu_verbosity > 2) printf(__VA_ARGS__)
 
 SDL_Renderer *renderer;
-
-byte memory[4096];   // 4K memory
-chip8registries cpu;
-Uint8 *keyboard_state;
-
-// Contains screen data.
-bool screen_buffer[64 * 32];
+bool headless;
+// Kept apart from cpu.running, which is machine state and is restored by load_state().
+bool quit_requested;
+
+bool random_input;
+unsigned random_input_state;
+unsigned random_input_hold;
+unsigned short random_input_keys;
+
+// Host key for each chip8 key.
+static const SDL_Scancode keymap[16] = {
+        SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,     // 0 1 2 3
+        SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,     // 4 5 6 7
+        SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,     // 8 9 A B
+        SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V      // C D E F
+};
 
 #define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
 #define BYTE_TO_BINARY(byte)  \
@@ -35,8 +45,13 @@ bool screen_buffer[64 * 32];
   (byte & 0x02 ? '1' : '0'), \
   (byte & 0x01 ? '1' : '0')
 
-int initialize_emulator(unsigned char verbose_level) {
+int initialize_emulator(unsigned char verbose_level, bool headless_mode) {
     cpu_verbosity = verbose_level;
+    headless = headless_mode;
+    if (headless) {
+        LOG("Running headless.\n");
+        return 0;
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         ERR("SDL_Init error: %s", SDL_GetError());
@@ -66,70 +81,52 @@ int initialize_emulator(unsigned char verbose_level) {
     return 0;
 }
 
-int load_rom(const char *file) {
-    // load rom
-    INFO("Loading rom %s...", file);
-
-    const unsigned max_size = 0xE00;
-
-    FILE *f = fopen(file, "rb");    // read in binary mode
-    if (f == NULL) {
-        ERR("\nCouldn't open %s (%s)\n", file, strerror(errno));
-        return 1;
-    }
-
-    // read file size size
-    fseek(f, 0, SEEK_END);
-    unsigned size = ftell(f);
-    rewind(f);
-    INFO(" [%u bytes]\n", size);
-
-    if (size > max_size) {
-        ERR("File size exceeds %u bytes. Can't load into memory.\n", max_size);
-        return 1;
-    }
-
-    fread(memory+PROGRAM_START_OFFSET, 1, max_size, f);
-    fclose(f);
-    return 0;
-}
-
-void run() {
+void run(unsigned long frame_limit) {
+    unsigned long frames = 0;
     while(cpu.running) {
-        handleNativeEvents();
+        if(!handleNativeEvents()) break;
         cycle();
+        if(frame_limit && ++frames >= frame_limit) break;
     }
 }
 
 void cycle() {
-    for(unsigned i = 0; i < STEPS_PER_CYCLE; ++i) {
+    unsigned long long frame_start = telemetry_clock();
+    unsigned i = 0;
+
+    // keys are sampled once per frame, so that a frame only depends on state and keypad
+    cpu.keypad = read_keypad();
+
+    while(i < STEPS_PER_CYCLE) {
         if(!cpu.running) return;
 
-        SDL_PumpEvents();
-        keyboard_state = (char *)SDL_GetKeyboardState(NULL);
-        cpu_process();
-        SDL_Delay(2);
+        // a recompiled block runs several instructions at once; keep the same pace per instruction
+        unsigned steps = cpu_process(STEPS_PER_CYCLE - i);
+        i += steps;
+        if(!headless) {
+            unsigned long long sleep_start = telemetry_clock();
+            SDL_Delay(2 * steps);
+            telemetry_sleep(sleep_start);
+        }
 
-        if(cpu.need_repaint) render_buffer();
+        if(cpu.need_repaint) {
+            unsigned long long render_start = telemetry_clock();
+            render_buffer();
+            telemetry_render(render_start);
+        }
     }
 
-    if(cpu.dt > 0) cpu.dt--;
-    if(cpu.st > 0) {
-        cpu.st--;
-        // TODO: play beep.
-    }
+    tick_timers();
+    capture_frame(screen_buffer);
+    telemetry_frame(frame_start, i);
 }
 
-void print_memory() {
-    printf("0x000: ");
-    for (unsigned i = 0; i < 4096; ++i) {
-        if(i % 16 == 0 && i) printf("\n0x%03x: ", i);
-        printf("%02x ", memory[i]);
+void render_buffer() {
+    if(headless) {
+        cpu.need_repaint = false;
+        return;
     }
-    printf("\n");
-}
 
-void render_buffer() {
     SDL_SetRenderDrawColor(renderer, BG_R, BG_G, BG_B, 255);
     SDL_RenderClear(renderer);
     SDL_SetRenderDrawColor(renderer, FG_R, FG_G, FG_B, 255);
@@ -152,100 +149,47 @@ void render_buffer() {
     cpu.need_repaint = false;
 }
 
-bool isKeyPressed(byte k) {
-    switch (k) {
-        case 0x1: return keyboard_state[SDL_SCANCODE_1] > 0;
-        case 0x2: return keyboard_state[SDL_SCANCODE_2] > 0;
-        case 0x3: return keyboard_state[SDL_SCANCODE_3] > 0;
-        case 0xC: return keyboard_state[SDL_SCANCODE_4] > 0;
-        case 0x4: return keyboard_state[SDL_SCANCODE_Q] > 0;
-        case 0x5: return keyboard_state[SDL_SCANCODE_W] > 0;
-        case 0x6: return keyboard_state[SDL_SCANCODE_E] > 0;
-        case 0xD: return keyboard_state[SDL_SCANCODE_R] > 0;
-        case 0x7: return keyboard_state[SDL_SCANCODE_A] > 0;
-        case 0x8: return keyboard_state[SDL_SCANCODE_S] > 0;
-        case 0x9: return keyboard_state[SDL_SCANCODE_D] > 0;
-        case 0xE: return keyboard_state[SDL_SCANCODE_F] > 0;
-        case 0xA: return keyboard_state[SDL_SCANCODE_Z] > 0;
-        case 0x0: return keyboard_state[SDL_SCANCODE_X] > 0;
-        case 0xB: return keyboard_state[SDL_SCANCODE_C] > 0;
-        case 0xF: return keyboard_state[SDL_SCANCODE_V] > 0;
+void use_random_input(unsigned seed) {
+    random_input = true;
+    random_input_state = seed;
+}
+
+unsigned short read_keypad() {
+    if(headless) {
+        if(!random_input) return 0;
+        // hold a random key (or none) for 4-35 frames
+        if(random_input_hold == 0) {
+            random_input_state = random_input_state * 1103515245 + 12345;
+            unsigned r = random_input_state >> 16;
+            random_input_keys = (r % 17) < 16 ? 1 << (r % 17) : 0;
+            random_input_hold = 4 + (r >> 5) % 32;
+        }
+        random_input_hold--;
+        return random_input_keys;
     }
+
+    SDL_PumpEvents();
+    const Uint8 *keyboard_state = SDL_GetKeyboardState(NULL);
+    unsigned short keys = 0;
+    for(byte k = 0; k < 16; ++k)
+        if(keyboard_state[keymap[k]]) keys |= 1 << k;
+    return keys;
 }
 
-void handleNativeEvents() {
+bool handleNativeEvents() {
+    if(headless) return true;
+
     // handle sdl_events
     SDL_Event event;
     while(SDL_PollEvent(&event)) {
         switch(event.type) {
             case SDL_KEYDOWN:
-                if(event.key.keysym.sym == SDLK_ESCAPE) cpu.running = false;
+                if(event.key.keysym.sym == SDLK_ESCAPE) quit_requested = true;
                 break;
             case SDL_QUIT:
-                cpu.running = false;
+                quit_requested = true;
                 break;
         }
     }
+    return !quit_requested;
 }
-
-byte getNextKeypress() {
-    for(byte i = 0; i < 16; ++i)
-        if(isKeyPressed(i)) return i;
-    return 255;
-}
-
-void clear_display() {
-    VERBOSE("CLS\n");
-    memset(screen_buffer, 0, sizeof(screen_buffer));
-    cpu.pc.WORD += 2;
-
-    cpu.need_repaint = true;
-}
-
-void draw(byte x, byte y, byte nib) {
-    VERBOSE("DRW V%x, V%x, 0x%01x\n", x, y, nib);
-
-    // set collision flag
-    cpu.v[0xF] = 0;
-
-    // blit sprite at I reg to Vx, Vy
-    for(unsigned h = 0; h < nib; ++h) {
-        unsigned rowOffset = (cpu.v[y] + h) * 64 + cpu.v[x];
-
-        // read a row of the sprite (always 1 byte)
-        byte sprite = memory[cpu.i.WORD + h];
-        for(unsigned v = 0; v < 8; ++v) {
-            // reads the v bit from sprite byte
-            byte offsetMask = 0x80 >> v;
-            bool spritePixel = (sprite & offsetMask);
-
-            if(spritePixel && screen_buffer[rowOffset + v])
-                cpu.v[0xF] = 1;
-
-            // XOR the new pixel value with the old
-            screen_buffer[rowOffset + v] ^= spritePixel;
-        }
-    }
-    cpu.need_repaint = true;
-    cpu.pc.WORD += 2;
-}
-
-void skip_if_key(byte reg) {
-    VERBOSE("SKP V%x\n", reg);
-    if (isKeyPressed(cpu.v[reg])) cpu.pc.WORD += 2;
-    cpu.pc.WORD += 2;
-}
-
-void skip_if_not_key(byte reg) {
-    VERBOSE("SKNP V%x\n", reg);
-    if (!isKeyPressed(cpu.v[reg])) cpu.pc.WORD += 2;
-    cpu.pc.WORD += 2;
-}
-
-void load_key(byte reg) {
-    VERBOSE("LD V%x, K\n", reg);
-
-    // halt until any key pressed
-    byte pressed = getNextKeypress();
-    if (pressed != 255) cpu.pc.WORD += 2;
-}
\ No newline at end of file
@@ -5,7 +5,7 @@
 #ifndef CHIP8_EMULATOR_H
 #define CHIP8_EMULATOR_H
 
-#include "cpu.h"
+#include "machine.h"
 
 #include <stdbool.h>
 
@@ -21,24 +21,22 @@ static unsigned const PIXEL_SIZE = 12;
 static unsigned const BEEP_AMPLITUDE = 10;
 static unsigned const BEEP_FREQUENCY = 28000;
 
-int initialize_emulator(unsigned char verbose_lvl);
-// Loads a rom into memory
-int load_rom(const char *file);
+// A headless emulator opens no window, reads no input and runs unthrottled.
+int initialize_emulator(unsigned char verbose_lvl, bool headless);
 
-// Starts the emulator.
-void run();
+// Starts the emulator. Stops after frame_limit frames (cycles), or when quit if 0.
+void run(unsigned long frame_limit);
 // Performs one cycle; performing multiple cpu updates, and updating timers.
 void cycle();
 
-void handleNativeEvents();
+// Handles window events. Returns false once the user has asked to quit.
+bool handleNativeEvents();
 
-bool isKeyPressed(byte k);
-// returns a pointer to the first key pressed. returns null if none.
-// Returns the first key pressed by index. if no index pressed, return 255.
-byte getNextKeypress();
+// Reads the keys currently held, bit k for key k. Headless, this is 0 or random input.
+unsigned short read_keypad();
+// Headless only: presses random keys from the given seed, for soak tests.
+void use_random_input(unsigned seed);
 
 void render_buffer();
 
-void print_memory();
-
 #endif //CHIP8_EMULATOR_H
@@ -0,0 +1,465 @@
+//
+// Created by olle on 2026-10-19.
+//
+// chip8-explore: breadth-first exploration of a rom's reachable states, for automated testing and coverage.
+//
+// Starting from the loaded rom, every state is forked once per frame into one child per keypad input (each of
+// the 16 keys alone, or none). Children that hash to an already visited state are dropped. Each breadth-first
+// level is expanded by a persistent pool of worker threads with work stealing. States store memory as 16 refcounted
+// 256-byte pages, shared copy-on-write with their parent, so a child only costs the pages its frame wrote.
+//
+
+#include "machine.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+unsigned char explore_verbosity = 1;
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define INFO(...) if(explore_verbosity > 0) printf(__VA_ARGS__)
+#define LOG(...) if(explore_verbosity > 1) printf(__VA_ARGS__)
+
+#define PAGE_SIZE 256
+#define PAGES (4096 / PAGE_SIZE)
+#define INPUTS 17               // keys 0-F, and no key
+#define NO_PARENT 0xFFFFFFFFu
+
+typedef struct {
+    unsigned refs;
+    unsigned long long hash;
+    byte data[PAGE_SIZE];
+} page;
+
+typedef struct {
+    chip8registries cpu;
+    page *pages[PAGES];
+    byte screen[64 * 32 / 8];   // packed, one bit per pixel
+    unsigned id;                // index into the path records
+} node;
+
+// Growable list of nodes, one per worker per level.
+typedef struct {
+    node *items;
+    unsigned size, capacity;
+} node_list;
+
+// A worker's share of the current level: frontier[next..end). Thieves take the upper half.
+typedef struct {
+    pthread_mutex_t lock;
+    unsigned next, end;
+    node_list children;
+    unsigned long long expanded, duplicates, halted;
+    pthread_t thread;
+    unsigned index;
+} worker;
+
+unsigned frames_per_input = 1;
+unsigned max_states = 1000000;
+unsigned worker_count;
+
+node *frontier;
+unsigned frontier_size;
+worker *workers;
+
+// Workers are started once. Each level runs between the two barriers, which the main thread joins too.
+pthread_barrier_t level_start, level_end;
+unsigned remaining;             // frontier nodes not yet expanded this level
+bool finished;
+
+// Visited states: open addressing on 64-bit hashes, inserted with compare-and-swap. 0 marks an empty slot.
+unsigned long long *visited;
+unsigned long long visited_mask;
+
+// How each state was reached, for reporting input sequences.
+unsigned *path_parent;
+byte *path_input;
+unsigned state_count;
+bool truncated;
+
+bool covered[4096];             // addresses executed by any state
+unsigned first_halt = NO_PARENT;
+
+// Hashing -----------------------------------------------------------------------------------------------------------
+
+unsigned long long mix(unsigned long long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+unsigned long long hash_block(const byte *data, unsigned length) {
+    unsigned long long h = length;
+    for(unsigned i = 0; i < length; i += 8) {
+        unsigned long long word;
+        memcpy(&word, data + i, 8);
+        h = mix(h ^ word) + i;
+    }
+    return h;
+}
+
+unsigned long long hash_registers(const chip8registries *c) {
+    byte fields[64];
+    unsigned n = 0;
+    memcpy(fields + n, c->v, sizeof(c->v)); n += sizeof(c->v);
+    memcpy(fields + n, &c->i.WORD, 2); n += 2;
+    memcpy(fields + n, &c->sp.WORD, 2); n += 2;
+    memcpy(fields + n, &c->pc.WORD, 2); n += 2;
+    fields[n++] = c->st;
+    fields[n++] = c->dt;
+    memcpy(fields + n, &c->rng, 4); n += 4;
+    memset(fields + n, 0, sizeof(fields) - n);
+    return hash_block(fields, sizeof(fields)) ^ mix(hash_block((const byte *)c->stack, sizeof(c->stack)));
+}
+
+// Returns true if the hash wasn't visited before.
+bool visit(unsigned long long hash) {
+    if(hash == 0) hash = 1;
+    for(unsigned long long slot = hash & visited_mask;; slot = (slot + 1) & visited_mask) {
+        unsigned long long seen = __atomic_load_n(&visited[slot], __ATOMIC_RELAXED);
+        if(seen == hash) return false;
+        if(seen == 0) {
+            if(__atomic_compare_exchange_n(&visited[slot], &seen, hash, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                return true;
+            if(seen == hash) return false;
+        }
+    }
+}
+
+// States ------------------------------------------------------------------------------------------------------------
+
+page *new_page(const byte *data, unsigned long long hash) {
+    page *p = malloc(sizeof(page));
+    p->refs = 1;
+    p->hash = hash;
+    memcpy(p->data, data, PAGE_SIZE);
+    return p;
+}
+
+void release_node(node *n) {
+    for(unsigned p = 0; p < PAGES; ++p)
+        if(__atomic_sub_fetch(&n->pages[p]->refs, 1, __ATOMIC_ACQ_REL) == 0) free(n->pages[p]);
+}
+
+void pack_screen(byte *packed) {
+    memset(packed, 0, 64 * 32 / 8);
+    for(unsigned i = 0; i < 64 * 32; ++i)
+        if(screen_buffer[i]) packed[i / 8] |= 1 << (i % 8);
+}
+
+// Loads a state into this thread's machine.
+void restore(const node *n) {
+    cpu = n->cpu;
+    for(unsigned p = 0; p < PAGES; ++p) memcpy(memory + p * PAGE_SIZE, n->pages[p]->data, PAGE_SIZE);
+    for(unsigned i = 0; i < 64 * 32; ++i) screen_buffer[i] = (n->screen[i / 8] >> (i % 8)) & 1;
+}
+
+unsigned add_path(unsigned parent, byte input) {
+    unsigned id = __atomic_fetch_add(&state_count, 1, __ATOMIC_RELAXED);
+    if(id >= max_states) {
+        __atomic_store_n(&truncated, true, __ATOMIC_RELAXED);
+        return NO_PARENT;
+    }
+    path_parent[id] = parent;
+    path_input[id] = input;
+    return id;
+}
+
+void push(node_list *list, const node *n) {
+    if(list->size == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->items = realloc(list->items, list->capacity * sizeof(node));
+    }
+    list->items[list->size++] = *n;
+}
+
+// Runs the machine for one input, with coverage.
+void run_frames(unsigned short keypad) {
+    cpu.keypad = keypad;
+    for(unsigned f = 0; f < frames_per_input && cpu.running; ++f) {
+        for(unsigned i = 0; i < STEPS_PER_CYCLE && cpu.running; ) {
+            __atomic_store_n(&covered[cpu.pc.WORD & 0xFFF], true, __ATOMIC_RELAXED);
+            i += cpu_process(STEPS_PER_CYCLE - i);
+        }
+        tick_timers();
+    }
+}
+
+void expand(worker *w, const node *parent) {
+    for(byte input = 0; input < INPUTS; ++input) {
+        restore(parent);
+        run_frames(input < 16 ? 1 << input : 0);
+
+        // only pages this frame changed get a new hash (and, if the state is new, new storage)
+        bool dirty[PAGES];
+        unsigned long long page_hash[PAGES];
+        unsigned long long hash = hash_registers(&cpu);
+        for(unsigned p = 0; p < PAGES; ++p) {
+            dirty[p] = memcmp(memory + p * PAGE_SIZE, parent->pages[p]->data, PAGE_SIZE) != 0;
+            page_hash[p] = dirty[p] ? hash_block(memory + p * PAGE_SIZE, PAGE_SIZE) : parent->pages[p]->hash;
+            hash = mix(hash + page_hash[p] + p);
+        }
+        node child;
+        pack_screen(child.screen);
+        hash = mix(hash ^ hash_block(child.screen, sizeof(child.screen)));
+
+        if(!visit(hash)) {
+            w->duplicates++;
+            continue;
+        }
+        child.id = add_path(parent->id, input);
+        if(child.id == NO_PARENT) return;
+
+        if(!cpu.running) {
+            // halted (unknown opcode or SYS); report, but don't explore further
+            w->halted++;
+            __atomic_compare_exchange_n(&first_halt, &(unsigned){ NO_PARENT }, child.id, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        child.cpu = cpu;
+        for(unsigned p = 0; p < PAGES; ++p) {
+            if(dirty[p]) {
+                child.pages[p] = new_page(memory + p * PAGE_SIZE, page_hash[p]);
+            } else {
+                child.pages[p] = parent->pages[p];
+                __atomic_add_fetch(&child.pages[p]->refs, 1, __ATOMIC_RELAXED);
+            }
+        }
+        push(&w->children, &child);
+    }
+    w->expanded++;
+}
+
+// Work stealing pool ------------------------------------------------------------------------------------------------
+
+bool take_own(worker *w, unsigned *item) {
+    pthread_mutex_lock(&w->lock);
+    bool found = w->next < w->end;
+    if(found) *item = w->next++;
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+// Moves the upper half of another worker's remaining range to w.
+bool steal(worker *w) {
+    for(unsigned k = 1; k < worker_count; ++k) {
+        worker *victim = &workers[(w->index + k) % worker_count];
+        pthread_mutex_lock(&victim->lock);
+        unsigned remaining = victim->end - victim->next;
+        unsigned start = victim->end - (remaining + 1) / 2, end = victim->end;
+        victim->end = start;
+        pthread_mutex_unlock(&victim->lock);
+
+        // our own range is empty, so thieves leave it alone until it is set here
+        if(remaining > 0) {
+            pthread_mutex_lock(&w->lock);
+            w->next = start;
+            w->end = end;
+            pthread_mutex_unlock(&w->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+void *worker_main(void *arg) {
+    worker *w = arg;
+    unsigned item;
+    for(;;) {
+        pthread_barrier_wait(&level_start);
+        if(finished) return NULL;
+
+        // a failed steal doesn't mean the level is done; a range may have just moved to another thief
+        while(__atomic_load_n(&remaining, __ATOMIC_ACQUIRE) > 0 && !__atomic_load_n(&truncated, __ATOMIC_RELAXED)) {
+            if(take_own(w, &item)) {
+                expand(w, &frontier[item]);
+                __atomic_sub_fetch(&remaining, 1, __ATOMIC_RELEASE);
+            } else if(!steal(w)) {
+                sched_yield();
+            }
+        }
+        pthread_barrier_wait(&level_end);
+    }
+}
+
+void start_workers() {
+    pthread_barrier_init(&level_start, NULL, worker_count + 1);
+    pthread_barrier_init(&level_end, NULL, worker_count + 1);
+    for(unsigned t = 0; t < worker_count; ++t) pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+}
+
+void stop_workers() {
+    finished = true;
+    pthread_barrier_wait(&level_start);
+    for(unsigned t = 0; t < worker_count; ++t) pthread_join(workers[t].thread, NULL);
+    pthread_barrier_destroy(&level_start);
+    pthread_barrier_destroy(&level_end);
+}
+
+// Expands the frontier by one level, and makes the children the new frontier.
+void explore_level() {
+    for(unsigned t = 0; t < worker_count; ++t) {
+        worker *w = &workers[t];
+        w->next = (unsigned long long)frontier_size * t / worker_count;
+        w->end = (unsigned long long)frontier_size * (t + 1) / worker_count;
+        w->children.size = 0;
+    }
+    remaining = frontier_size;
+    pthread_barrier_wait(&level_start);
+    pthread_barrier_wait(&level_end);
+
+    unsigned children = 0;
+    for(unsigned t = 0; t < worker_count; ++t) children += workers[t].children.size;
+
+    for(unsigned i = 0; i < frontier_size; ++i) release_node(&frontier[i]);
+    frontier = realloc(frontier, (children ? children : 1) * sizeof(node));
+    frontier_size = 0;
+    for(unsigned t = 0; t < worker_count; ++t) {
+        memcpy(frontier + frontier_size, workers[t].children.items, workers[t].children.size * sizeof(node));
+        frontier_size += workers[t].children.size;
+    }
+}
+
+// Reporting ---------------------------------------------------------------------------------------------------------
+
+void print_path(unsigned id) {
+    unsigned length = 0;
+    for(unsigned s = id; path_parent[s] != NO_PARENT; s = path_parent[s]) length++;
+
+    byte *inputs = malloc(length + 1);
+    unsigned i = length;
+    for(unsigned s = id; path_parent[s] != NO_PARENT; s = path_parent[s]) inputs[--i] = path_input[s];
+    for(i = 0; i < length; ++i) {
+        if(inputs[i] < 16) printf("%X", inputs[i]);
+        else printf("-");
+    }
+    printf(" (%u inputs, %u frames each; - is no key)\n", length, frames_per_input);
+    free(inputs);
+}
+
+void print_coverage() {
+    unsigned count = 0;
+    for(unsigned addr = PROGRAM_START_OFFSET; addr < sizeof(covered); ++addr) count += covered[addr];
+    INFO("%u instruction addresses covered\n", count);
+
+    if(explore_verbosity < 2) return;
+    for(unsigned addr = PROGRAM_START_OFFSET; addr < sizeof(covered); ++addr)
+        if(covered[addr]) printf("0x%03x\n", addr);
+}
+
+int main(const int argc, char **argv) {
+    int helpflag = 0;
+    unsigned max_depth = 600;
+    worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    extern char *optarg;
+    extern int optind, optopt;
+    while ((opt = getopt(argc, argv, "hv:d:s:f:j:")) != -1) {
+        switch (opt) {
+        case 'h':
+            helpflag++;
+            break;
+        case 'v':
+            explore_verbosity = atoi(optarg);
+            break;
+        case 'd':
+            max_depth = atoi(optarg);
+            break;
+        case 's':
+            max_states = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            frames_per_input = atoi(optarg);
+            break;
+        case 'j':
+            worker_count = atoi(optarg);
+            break;
+        case '?':
+            ERR("Unrecognized option: '-%c'\n", optopt);
+            helpflag++;
+        }
+    }
+
+    if(argv[optind] == NULL) {
+        ERR("Mandatory argument missing.\n");
+        helpflag++;
+    }
+
+    if(helpflag) {
+        const char *helpstr =
+          "usage: %s [options] rom\n"
+          "options:\n"
+          "  -d [num]   Maximum depth in inputs (default 600).\n"
+          "  -s [num]   Maximum number of states (default 1000000).\n"
+          "  -f [num]   Frames each input is held for (default 1).\n"
+          "  -j [num]   Worker threads (default: one per core).\n"
+          "  -v [lvl]   Sets the verbosity level (default 1); 2 lists covered addresses.\n"
+          "  -h         Displays help.\n";
+        printf(helpstr, argv[0]);
+        return 2;
+    }
+    if(worker_count < 1) worker_count = 1;
+    if(frames_per_input < 1) frames_per_input = 1;
+
+    initialize_machine(0);
+    if(load_rom(argv[optind]) > 0) return 1;
+    initialize_cpu(0);
+
+    unsigned long long slots = 1;
+    while(slots < 2ULL * max_states) slots <<= 1;
+    visited = calloc(slots, sizeof(*visited));
+    visited_mask = slots - 1;
+    path_parent = malloc(max_states * sizeof(*path_parent));
+    path_input = malloc(max_states * sizeof(*path_input));
+    workers = calloc(worker_count, sizeof(worker));
+    for(unsigned t = 0; t < worker_count; ++t) {
+        pthread_mutex_init(&workers[t].lock, NULL);
+        workers[t].index = t;
+    }
+
+    // the initial state is the root of every path
+    node root;
+    root.cpu = cpu;
+    for(unsigned p = 0; p < PAGES; ++p)
+        root.pages[p] = new_page(memory + p * PAGE_SIZE, hash_block(memory + p * PAGE_SIZE, PAGE_SIZE));
+    pack_screen(root.screen);
+    root.id = add_path(NO_PARENT, 0);
+    frontier = malloc(sizeof(node));
+    frontier[0] = root;
+    frontier_size = 1;
+
+    INFO("Exploring %s with %u threads\n", argv[optind], worker_count);
+    start_workers();
+    unsigned depth = 0;
+    while(frontier_size > 0 && depth < max_depth && !truncated) {
+        explore_level();
+        depth++;
+        LOG("depth %u: %u new states\n", depth, frontier_size);
+    }
+    stop_workers();
+
+    unsigned long long expanded = 0, duplicates = 0, halted = 0;
+    for(unsigned t = 0; t < worker_count; ++t) {
+        expanded += workers[t].expanded;
+        duplicates += workers[t].duplicates;
+        halted += workers[t].halted;
+    }
+    unsigned states = state_count < max_states ? state_count : max_states;
+    INFO("%u unique states to depth %u%s; %llu expanded, %llu duplicate children, %llu halted\n", states, depth,
+         truncated ? " (state limit reached)" : frontier_size == 0 ? " (exhausted)" : "", expanded, duplicates,
+         halted);
+    print_coverage();
+    if(first_halt != NO_PARENT) {
+        INFO("Machine halts after input ");
+        if(explore_verbosity > 0) print_path(first_halt);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#include "machine.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Macro for verbose printing. 0 = no prints, 1 = only info, etc.
+unsigned char machine_verbosity;
+#define ERR(...) printf(__VA_ARGS__)
+#define INFO(...) if(machine_verbosity > 0) printf(__VA_ARGS__)
+#define LOG(...) if(machine_verbosity > 1) printf(__VA_ARGS__)
+#define VERBOSE(...) if(machine_verbosity > 2) printf(__VA_ARGS__)
+
+__thread byte memory[4096];   // 4K memory
+__thread chip8registries cpu;
+__thread bool screen_buffer[64 * 32];
+
+void initialize_machine(unsigned char verbose_lvl) {
+    machine_verbosity = verbose_lvl;
+}
+
+int load_rom(const char *file) {
+    // load rom
+    INFO("Loading rom %s...", file);
+
+    const unsigned max_size = 0xE00;
+
+    FILE *f = fopen(file, "rb");    // read in binary mode
+    if (f == NULL) {
+        ERR("\nCouldn't open %s (%s)\n", file, strerror(errno));
+        return 1;
+    }
+
+    // read file size size
+    fseek(f, 0, SEEK_END);
+    unsigned size = ftell(f);
+    rewind(f);
+    INFO(" [%u bytes]\n", size);
+
+    if (size > max_size) {
+        ERR("File size exceeds %u bytes. Can't load into memory.\n", max_size);
+        return 1;
+    }
+
+    fread(memory+PROGRAM_START_OFFSET, 1, max_size, f);
+    fclose(f);
+    return 0;
+}
+
+unsigned emulate_frame() {
+    unsigned i = 0;
+    while(i < STEPS_PER_CYCLE && cpu.running)
+        i += cpu_process(STEPS_PER_CYCLE - i);
+    tick_timers();
+    return i;
+}
+
+void tick_timers() {
+    if(cpu.dt > 0) cpu.dt--;
+    if(cpu.st > 0) {
+        cpu.st--;
+        // TODO: play beep.
+    }
+}
+
+void save_state(chip8state *state) {
+    state->cpu = cpu;
+    memcpy(state->memory, memory, sizeof(memory));
+    memcpy(state->screen, screen_buffer, sizeof(screen_buffer));
+}
+
+void load_state(const chip8state *state) {
+    cpu = state->cpu;
+    memcpy(memory, state->memory, sizeof(memory));
+    memcpy(screen_buffer, state->screen, sizeof(screen_buffer));
+}
+
+// FNV-1a over the machine state. Covers fields rather than the struct, so padding bytes don't matter.
+unsigned hash_bytes(unsigned h, const void *data, unsigned length) {
+    const byte *p = data;
+    for(unsigned i = 0; i < length; ++i) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+unsigned hash_state(const chip8state *state) {
+    const chip8registries *c = &state->cpu;
+    unsigned h = 2166136261u;
+    h = hash_bytes(h, c->v, sizeof(c->v));
+    h = hash_bytes(h, &c->i.WORD, sizeof(c->i.WORD));
+    h = hash_bytes(h, &c->sp.WORD, sizeof(c->sp.WORD));
+    h = hash_bytes(h, &c->pc.WORD, sizeof(c->pc.WORD));
+    h = hash_bytes(h, &c->st, 1);
+    h = hash_bytes(h, &c->dt, 1);
+    h = hash_bytes(h, c->stack, sizeof(c->stack));
+    h = hash_bytes(h, &c->rng, sizeof(c->rng));
+    h = hash_bytes(h, state->memory, sizeof(state->memory));
+    return hash_bytes(h, state->screen, sizeof(state->screen));
+}
+
+void print_memory() {
+    printf("0x000: ");
+    for (unsigned i = 0; i < 4096; ++i) {
+        if(i % 16 == 0 && i) printf("\n0x%03x: ", i);
+        printf("%02x ", memory[i]);
+    }
+    printf("\n");
+}
+
+bool isKeyPressed(byte k) {
+    return k < 16 && (cpu.keypad >> k) & 1;
+}
+
+byte getNextKeypress() {
+    for(byte i = 0; i < 16; ++i)
+        if(isKeyPressed(i)) return i;
+    return 255;
+}
+
+void clear_display() {
+    VERBOSE("CLS\n");
+    memset(screen_buffer, 0, sizeof(screen_buffer));
+    cpu.pc.WORD += 2;
+
+    cpu.need_repaint = true;
+}
+
+void draw(byte x, byte y, byte nib) {
+    VERBOSE("DRW V%x, V%x, 0x%01x\n", x, y, nib);
+
+    // set collision flag
+    cpu.v[0xF] = 0;
+
+    // blit sprite at I reg to Vx, Vy. Sprites wrap around the screen edges; writing past screen_buffer
+    // would touch state outside the machine, which breaks snapshots and replays.
+    for(unsigned h = 0; h < nib; ++h) {
+        unsigned rowOffset = ((cpu.v[y] + h) % 32) * 64;
+
+        // read a row of the sprite (always 1 byte)
+        byte sprite = memory[(cpu.i.WORD + h) & 0xFFF];
+        for(unsigned v = 0; v < 8; ++v) {
+            unsigned pixel = rowOffset + (cpu.v[x] + v) % 64;
+
+            // reads the v bit from sprite byte
+            byte offsetMask = 0x80 >> v;
+            bool spritePixel = (sprite & offsetMask);
+
+            if(spritePixel && screen_buffer[pixel])
+                cpu.v[0xF] = 1;
+
+            // XOR the new pixel value with the old
+            screen_buffer[pixel] ^= spritePixel;
+        }
+    }
+    cpu.need_repaint = true;
+    cpu.pc.WORD += 2;
+}
+
+void skip_if_key(byte reg) {
+    VERBOSE("SKP V%x\n", reg);
+    if (isKeyPressed(cpu.v[reg])) cpu.pc.WORD += 2;
+    cpu.pc.WORD += 2;
+}
+
+void skip_if_not_key(byte reg) {
+    VERBOSE("SKNP V%x\n", reg);
+    if (!isKeyPressed(cpu.v[reg])) cpu.pc.WORD += 2;
+    cpu.pc.WORD += 2;
+}
+
+void load_key(byte reg) {
+    VERBOSE("LD V%x, K\n", reg);
+
+    // halt until any key pressed
+    byte pressed = getNextKeypress();
+    if (pressed != 255) cpu.pc.WORD += 2;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#ifndef CHIP8_MACHINE_H
+#define CHIP8_MACHINE_H
+
+#include "cpu.h"
+
+#include <stdbool.h>
+
+// The machine without any host i/o: memory, registers, screen and keypad, and the instructions that use them.
+// Machine state is per thread, so several machines can run side by side (see explorer.c).
+
+// Contains screen data.
+extern __thread bool screen_buffer[64 * 32];
+
+// Everything a frame's outcome depends on, given the keypad. Small enough to copy several times per frame.
+typedef struct {
+    chip8registries cpu;
+    byte memory[4096];
+    bool screen[64 * 32];
+} chip8state;
+
+void initialize_machine(unsigned char verbose_lvl);
+// Loads a rom into memory
+int load_rom(const char *file);
+
+// Performs one cycle with the current keypad as fast as possible; no input, delays or rendering.
+// Returns the number of instructions executed (fewer than STEPS_PER_CYCLE if the machine halts).
+unsigned emulate_frame();
+void tick_timers();
+
+void save_state(chip8state *state);
+void load_state(const chip8state *state);
+unsigned hash_state(const chip8state *state);
+
+bool isKeyPressed(byte k);
+// Returns the first key pressed by index. if no index pressed, return 255.
+byte getNextKeypress();
+
+void print_memory();
+
+#endif //CHIP8_MACHINE_H
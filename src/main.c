@@ -3,6 +3,9 @@
 #include <unistd.h>
 
 #include "emulator.h"
+#include "capture.h"
+#include "telemetry.h"
+#include "netplay.h"
 #include "cpu.h"
 
 #define ERR(...) fprintf(stderr, __VA_ARGS__)
@@ -11,12 +14,19 @@ int main(const int argc, char **argv) {
 
     int helpflag = 0;
     unsigned char verbosity = 1;
+    bool headless = false;
+    unsigned long frame_limit = 0;
+    const char *capture_path = NULL;
+    const char *telemetry_path = NULL;
+    const char *netplay_address = NULL;
+    unsigned input_delay = 2;
+    unsigned latency = 0;
 
     // Parse command line options
     int opt;
     extern char *optarg;
     extern int opterr, optind, optopt;
-    while ((opt = getopt(argc, argv, "hv:")) != -1) {
+    while ((opt = getopt(argc, argv, "hv:Hn:c:t:R:N:d:L:")) != -1) {
         switch (opt) {
         case 'h': // help
             helpflag++;
@@ -24,6 +34,30 @@ int main(const int argc, char **argv) {
         case 'v': // set verbosity
             verbosity = atoi(optarg);
             break;
+        case 'H': // headless
+            headless = true;
+            break;
+        case 'n': // stop after a number of frames
+            frame_limit = strtoul(optarg, NULL, 10);
+            break;
+        case 'c': // capture frames
+            capture_path = optarg;
+            break;
+        case 't': // serve telemetry
+            telemetry_path = optarg;
+            break;
+        case 'R': // random input
+            use_random_input(strtoul(optarg, NULL, 10));
+            break;
+        case 'N': // netplay
+            netplay_address = optarg;
+            break;
+        case 'd': // netplay input delay
+            input_delay = atoi(optarg);
+            break;
+        case 'L': // simulated netplay latency
+            latency = atoi(optarg);
+            break;
         case ':': // arg without operand
             ERR("Option -%c requires an operand\n", opt);
             helpflag++;
@@ -46,19 +80,40 @@ int main(const int argc, char **argv) {
           "usage: %s [options] rom\n"
           "options:\n"
           "  -v [lvl]   Sets the verbosity level (default 1).\n"
+          "  -H         Runs headless: no window, no input, unthrottled.\n"
+          "  -n [num]   Stops after num frames.\n"
+          "  -c [file]  Captures frames to a .y4m video, or a png sequence (e.g. frame%%05u.png).\n"
+          "  -t [sock]  Serves run loop metrics (Prometheus text format) on a Unix socket.\n"
+          "  -R [seed]  Presses random keys when headless, for soak tests.\n"
+          "  -N [addr]  Two-player netplay over UDP; addr is localport:host:remoteport.\n"
+          "  -d [num]   Netplay input delay in frames (default 2).\n"
+          "  -L [ms]    Adds simulated latency to sent netplay packets.\n"
           "  -h         Displays help.\n";
         printf(helpstr, argv[0]);
         return 2;
     }
 
-    initialize_emulator(verbosity);
+    initialize_machine(verbosity);
+    initialize_emulator(verbosity, headless);
 
     int status = load_rom(argv[optind]);
     if (status > 0) return 1;
 
     initialize_cpu(verbosity);
 
-    run();
+    if (capture_path != NULL && capture_open(capture_path, headless, verbosity) > 0) return 1;
+    if (telemetry_path != NULL && telemetry_open(telemetry_path, verbosity) > 0) return 1;
+
+    if (netplay_address != NULL) {
+        if (netplay_open(netplay_address, input_delay, latency, verbosity) > 0) return 1;
+        netplay_run(frame_limit);
+        netplay_close();
+    } else {
+        run(frame_limit);
+    }
+
+    telemetry_close();
+    capture_close();
 
     return 0;
 }
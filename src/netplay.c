@@ -0,0 +1,325 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#include "netplay.h"
+#include "emulator.h"
+#include "capture.h"
+#include "telemetry.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Macro for verbose printing. 0 = no prints, 1 = only info, etc.
+unsigned char netplay_verbosity;
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define INFO(...) if(netplay_verbosity > 0) printf(__VA_ARGS__)
+#define LOG(...) if(netplay_verbosity > 1) printf(__VA_ARGS__)
+#define VERBOSE(...) if(netplay_verbosity > 2) printf(__VA_ARGS__)
+
+#define HISTORY 64          // frames of input and snapshots kept, indexed by frame % HISTORY
+#define PACKET_INPUTS 64    // inputs per packet, oldest unacknowledged first
+#define PACKET_SIZE (22 + 2 * PACKET_INPUTS)
+#define DELAY_QUEUE 256     // packets held back by simulated latency
+
+static const unsigned PACKET_MAGIC = 0x43384e50;    // "C8NP"
+static const byte PACKET_QUIT = 0x01;
+static const unsigned NO_ROLLBACK = ~0u;
+
+typedef struct {
+    unsigned long long due;
+    unsigned length;
+    byte data[PACKET_SIZE];
+} delayed_packet;
+
+int sock = -1;
+struct sockaddr_storage peer;
+socklen_t peer_length;
+unsigned input_delay;
+unsigned long long latency;     // nanoseconds
+
+unsigned short local_input[HISTORY];
+unsigned short remote_input[HISTORY];
+unsigned short predicted_input[HISTORY];    // remote input each frame was simulated with
+chip8state snapshots[HISTORY];              // state at the start of each frame
+
+unsigned frame;             // next frame to simulate
+unsigned local_through;     // local input is known for frames below this
+unsigned remote_through;    // remote input is known for frames below this
+unsigned peer_through;      // the peer has our input for frames below this
+unsigned rollback_from = NO_ROLLBACK;  // earliest frame simulated with a wrong prediction
+bool peer_quit;
+
+delayed_packet delayed[DELAY_QUEUE];
+unsigned delayed_head, delayed_size;
+
+unsigned long rollbacks, resimulated, stalls, sync_checks, desyncs;
+unsigned instructions;      // executed since the last frame reported to telemetry, re-simulation included
+unsigned last_sync_checked = NO_ROLLBACK;
+
+unsigned long long netplay_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Packets ------------------------------------------------------------------------------------------------------------
+
+byte *put32(byte *out, unsigned v) {
+    out[0] = v >> 24; out[1] = v >> 16; out[2] = v >> 8; out[3] = v;
+    return out + 4;
+}
+
+unsigned get32(const byte *in) {
+    return (unsigned)in[0] << 24 | (unsigned)in[1] << 16 | (unsigned)in[2] << 8 | in[3];
+}
+
+void send_now(const byte *data, unsigned length) {
+    sendto(sock, data, length, 0, (struct sockaddr *)&peer, peer_length);
+}
+
+void flush_delayed(bool all) {
+    unsigned long long now = netplay_clock();
+    while(delayed_size > 0 && (all || delayed[delayed_head].due <= now)) {
+        send_now(delayed[delayed_head].data, delayed[delayed_head].length);
+        delayed_head = (delayed_head + 1) % DELAY_QUEUE;
+        delayed_size--;
+    }
+}
+
+// Latest frame whose snapshot was simulated with confirmed input only.
+bool confirmed_sync_frame(unsigned *sync_frame) {
+    unsigned confirmed = remote_through < frame ? remote_through : frame;
+    if(confirmed == 0) return false;
+    *sync_frame = (confirmed - 1) - (confirmed - 1) % NETPLAY_SYNC_INTERVAL;
+    return true;
+}
+
+// Layout (big-endian): magic, flags, first input frame, input count, ack, sync frame, sync hash, inputs.
+void send_input(byte flags) {
+    byte data[PACKET_SIZE];
+    unsigned first = peer_through;
+    unsigned count = local_through - first;
+    if(count > PACKET_INPUTS) count = PACKET_INPUTS;
+
+    unsigned sync_frame = 0, sync_hash = 0;
+    if(confirmed_sync_frame(&sync_frame)) sync_hash = hash_state(&snapshots[sync_frame % HISTORY]);
+    else sync_frame = NO_ROLLBACK;
+
+    byte *out = put32(data, PACKET_MAGIC);
+    *out++ = flags;
+    out = put32(out, first);
+    *out++ = count;
+    out = put32(out, remote_through);
+    out = put32(out, sync_frame);
+    out = put32(out, sync_hash);
+    for(unsigned i = 0; i < count; ++i) {
+        unsigned short keys = local_input[(first + i) % HISTORY];
+        *out++ = keys >> 8;
+        *out++ = keys;
+    }
+
+    unsigned length = out - data;
+    if(latency == 0) {
+        send_now(data, length);
+        return;
+    }
+    if(delayed_size == DELAY_QUEUE) return;     // acts as packet loss; later packets resend the input
+    delayed_packet *p = &delayed[(delayed_head + delayed_size++) % DELAY_QUEUE];
+    p->due = netplay_clock() + latency;
+    p->length = length;
+    memcpy(p->data, data, length);
+}
+
+void check_sync(unsigned sync_frame, unsigned sync_hash) {
+    unsigned ours;
+    if(sync_frame == NO_ROLLBACK || sync_frame == last_sync_checked) return;
+    if(!confirmed_sync_frame(&ours) || sync_frame > ours || sync_frame + HISTORY <= frame) return;
+    // snapshots after a pending rollback are stale
+    if(sync_frame > rollback_from) return;
+
+    last_sync_checked = sync_frame;
+    sync_checks++;
+    if(hash_state(&snapshots[sync_frame % HISTORY]) != sync_hash) {
+        desyncs++;
+        ERR("Netplay desync at frame %u\n", sync_frame);
+    }
+}
+
+void receive_packets() {
+    byte data[PACKET_SIZE];
+    int length;
+
+    while((length = recv(sock, data, sizeof(data), MSG_DONTWAIT)) > 0) {
+        if(length < 22 || get32(data) != PACKET_MAGIC) continue;
+
+        byte flags = data[4];
+        unsigned first = get32(data + 5);
+        unsigned count = data[9];
+        unsigned ack = get32(data + 10);
+        if(length < 22 + 2 * (int)count) continue;
+
+        if(flags & PACKET_QUIT) peer_quit = true;
+        if(ack > peer_through && ack <= local_through) peer_through = ack;
+
+        // inputs are contiguous from the oldest we haven't acknowledged
+        for(unsigned f = first; f < first + count; ++f) {
+            if(f < remote_through) continue;
+            if(f > remote_through || f >= frame + HISTORY - NETPLAY_MAX_ROLLBACK) break;
+
+            unsigned short keys = data[22 + 2 * (f - first)] << 8 | data[23 + 2 * (f - first)];
+            remote_input[f % HISTORY] = keys;
+            remote_through = f + 1;
+            if(f < frame && predicted_input[f % HISTORY] != keys && f < rollback_from) rollback_from = f;
+        }
+
+        check_sync(get32(data + 14), get32(data + 18));
+    }
+}
+
+// Simulation --------------------------------------------------------------------------------------------------------
+
+unsigned short predict_remote(unsigned f) {
+    if(f < remote_through) return remote_input[f % HISTORY];
+    return remote_through > 0 ? remote_input[(remote_through - 1) % HISTORY] : 0;
+}
+
+void simulate(unsigned f) {
+    save_state(&snapshots[f % HISTORY]);
+    unsigned short remote = predict_remote(f);
+    predicted_input[f % HISTORY] = remote;
+    cpu.keypad = local_input[f % HISTORY] | remote;
+    instructions += emulate_frame();
+}
+
+void rollback() {
+    VERBOSE("rollback %u -> %u\n", frame, rollback_from);
+    load_state(&snapshots[rollback_from % HISTORY]);
+    for(unsigned f = rollback_from; f < frame; ++f) simulate(f);
+
+    rollbacks++;
+    resimulated += frame - rollback_from;
+    rollback_from = NO_ROLLBACK;
+}
+
+// Sleeps until deadline, handling packets as they arrive and releasing delayed ones on time.
+void wait_until(unsigned long long deadline) {
+    for(;;) {
+        unsigned long long now = netplay_clock();
+        if(now >= deadline) return;
+
+        unsigned long long wake = deadline;
+        if(delayed_size > 0 && delayed[delayed_head].due < wake) wake = delayed[delayed_head].due;
+        struct pollfd fds = { sock, POLLIN, 0 };
+        poll(&fds, 1, wake > now ? (int)((wake - now + 999999) / 1000000) : 0);
+
+        receive_packets();
+        flush_delayed(false);
+    }
+}
+
+void netplay_run(unsigned long frame_limit) {
+    const unsigned long long tick = 1000000000ULL / 60;
+    unsigned long long next_tick = netplay_clock();
+
+    while(cpu.running && !peer_quit) {
+        if(!handleNativeEvents()) break;
+        receive_packets();
+        if(rollback_from < frame) rollback();
+
+        if(frame < remote_through + NETPLAY_MAX_ROLLBACK) {
+            unsigned long long frame_start = telemetry_clock();
+            local_input[local_through % HISTORY] = read_keypad();
+            local_through++;
+            simulate(frame++);
+
+            if(cpu.need_repaint) {
+                unsigned long long render_start = telemetry_clock();
+                render_buffer();
+                telemetry_render(render_start);
+            }
+            capture_frame(screen_buffer);
+            telemetry_frame(frame_start, instructions);
+            instructions = 0;
+        } else {
+            stalls++;
+        }
+        send_input(0);
+
+        if(frame_limit && frame >= frame_limit) break;
+
+        // don't try to catch up after a long stall
+        next_tick += tick;
+        unsigned long long now = netplay_clock();
+        if(now > next_tick + 4 * tick) next_tick = now;
+        wait_until(next_tick);
+    }
+
+    send_input(PACKET_QUIT);
+    flush_delayed(true);
+    INFO("Netplay: %u frames, %lu rollbacks (%lu frames re-simulated), %lu stalls, %lu/%lu sync checks passed\n",
+         frame, rollbacks, resimulated, stalls, sync_checks - desyncs, sync_checks);
+}
+
+// Setup -------------------------------------------------------------------------------------------------------------
+
+int netplay_open(const char *address, unsigned delay, unsigned latency_ms, unsigned char verbose_lvl) {
+    netplay_verbosity = verbose_lvl;
+
+    char local_port[16], host[256], remote_port[16];
+    if(sscanf(address, "%15[^:]:%255[^:]:%15s", local_port, host, remote_port) != 3) {
+        ERR("Netplay address must be localport:host:remoteport (got %s)\n", address);
+        return 1;
+    }
+    if(delay > NETPLAY_MAX_INPUT_DELAY) {
+        ERR("Input delay can be at most %u frames\n", NETPLAY_MAX_INPUT_DELAY);
+        return 1;
+    }
+
+    struct addrinfo hints, *remote, *local;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    int status = getaddrinfo(host, remote_port, &hints, &remote);
+    if(status != 0) {
+        ERR("Couldn't resolve %s:%s (%s)\n", host, remote_port, gai_strerror(status));
+        return 1;
+    }
+    memcpy(&peer, remote->ai_addr, remote->ai_addrlen);
+    peer_length = remote->ai_addrlen;
+
+    hints.ai_family = remote->ai_family;
+    hints.ai_flags = AI_PASSIVE;
+    freeaddrinfo(remote);
+    status = getaddrinfo(NULL, local_port, &hints, &local);
+    if(status != 0) {
+        ERR("Couldn't resolve local port %s (%s)\n", local_port, gai_strerror(status));
+        return 1;
+    }
+    sock = socket(local->ai_family, SOCK_DGRAM, 0);
+    if(sock < 0 || bind(sock, local->ai_addr, local->ai_addrlen) != 0) {
+        ERR("Couldn't bind port %s (%s)\n", local_port, strerror(errno));
+        freeaddrinfo(local);
+        return 1;
+    }
+    freeaddrinfo(local);
+
+    // the first input_delay frames have no local input
+    input_delay = delay;
+    local_through = delay;
+    latency = latency_ms * 1000000ULL;
+
+    INFO("Netplay on port %s with %s:%s, %u frames input delay\n", local_port, host, remote_port, delay);
+    return 0;
+}
+
+void netplay_close() {
+    if(sock >= 0) close(sock);
+    sock = -1;
+}
@@ -0,0 +1,25 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#ifndef CHIP8_NETPLAY_H
+#define CHIP8_NETPLAY_H
+
+// Two-player netplay over UDP. Both emulators run the same rom in lockstep, and each frame the keypad is the
+// union of both players' keys (two-player roms give each player their own keys). Local input is applied
+// input_delay frames late to hide latency. Missing remote input is predicted to be unchanged; when it arrives
+// and differs, the machine restores the snapshot of that frame and re-simulates up to the present.
+
+// Frames the simulation may run ahead of the last confirmed remote input before it waits.
+static unsigned const NETPLAY_MAX_ROLLBACK = 8;
+static unsigned const NETPLAY_MAX_INPUT_DELAY = 16;
+// Frames between the state hashes peers exchange to detect desyncs.
+static unsigned const NETPLAY_SYNC_INTERVAL = 16;
+
+// address is "localport:host:remoteport". latency (ms) is added to every sent packet, for testing.
+int netplay_open(const char *address, unsigned input_delay, unsigned latency, unsigned char verbose_lvl);
+// Runs the emulator at 60 frames per second until quit, the peer quits or frame_limit frames (if not 0).
+void netplay_run(unsigned long frame_limit);
+void netplay_close();
+
+#endif //CHIP8_NETPLAY_H
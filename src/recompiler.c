@@ -0,0 +1,408 @@
+//
+// Created by olle on 2026-10-19.
+//
+// chip8rc: ahead-of-time recompiler from a chip8 rom to C.
+//
+// Reachable code is found by recursive disassembly from PROGRAM_START_OFFSET, following jumps, calls and
+// both paths of every skip. Each basic block becomes one C function, and the generated aot_execute()
+// dispatches on pc. The output is compiled together with the normal runtime (see CHIP8_AOT in cpu.c), which
+// falls back to the interpreter whenever pc is not at a known block, when a block's bytes in memory no
+// longer match the rom it was compiled from (self-modifying code), or when a block has more instructions than
+// are left in the frame.
+//
+
+#include "cpu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+unsigned char verbosity = 1;
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define INFO(...) if(verbosity > 0) fprintf(stderr, __VA_ARGS__)
+#define LOG(...) if(verbosity > 1) fprintf(stderr, __VA_ARGS__)
+
+// How an instruction affects the control flow of a basic block.
+typedef enum {
+    OP_FALLBACK,    // not recompiled; left to the interpreter (0nnn, Bnnn, malformed opcodes)
+    OP_STRAIGHT,    // falls through to the next instruction
+    OP_STORE,       // falls through, but writes memory so the block must end (self-modifying code)
+    OP_CALLOUT,     // calls into the runtime (CLS, DRW, LD Vx K), ends the block
+    OP_SKIP,        // conditional skip; continues at pc+2 or pc+4
+    OP_JUMP,        // 1nnn
+    OP_CALL,        // 2nnn
+    OP_RETURN       // 00EE
+} opkind;
+
+byte image[4096];           // rom, loaded at the same offset as in the emulator
+unsigned image_end;         // first address after the rom
+
+bool reachable[4096];       // an instruction starts at this address
+bool leader[4096];          // a basic block starts at this address
+
+word fetch(unsigned addr) {
+    word code;
+    code.BYTE.high = image[addr];
+    code.BYTE.low = image[addr+1];
+    return code;
+}
+
+// Classifies an opcode the same way execute_opcode() decodes it. Opcodes the interpreter only reaches through
+// switch fall-through are left to the interpreter, so the generated code never has to mimic that.
+opkind classify(word code) {
+    byte n = code.WORD & 0x000F;
+    byte kk = code.BYTE.low;
+
+    if (code.WORD == 0x00E0) return OP_CALLOUT;
+    if (code.WORD == 0x00EE) return OP_RETURN;
+
+    switch (code.WORD >> 12) {
+        case 0x0: return OP_FALLBACK;
+        case 0x1: return OP_JUMP;
+        case 0x2: return OP_CALL;
+        case 0x3:
+        case 0x4: return OP_SKIP;
+        case 0x5: return n == 0 ? OP_SKIP : OP_FALLBACK;
+        case 0x6:
+        case 0x7: return OP_STRAIGHT;
+        case 0x8:
+            if (n <= 0x7 || n == 0xE) return OP_STRAIGHT;
+            return OP_FALLBACK;
+        case 0x9: return n == 0 ? OP_SKIP : OP_FALLBACK;
+        case 0xA: return OP_STRAIGHT;
+        case 0xB: return OP_FALLBACK;
+        case 0xC: return OP_STRAIGHT;
+        case 0xD: return OP_CALLOUT;
+        case 0xE:
+            if (kk == 0x9E || kk == 0xA1) return OP_SKIP;
+            return OP_FALLBACK;
+        case 0xF:
+            switch (kk) {
+                case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x65: return OP_STRAIGHT;
+                case 0x33: case 0x55: return OP_STORE;
+                case 0x0A: return OP_CALLOUT;
+            }
+    }
+    return OP_FALLBACK;
+}
+
+bool in_image(unsigned addr) {
+    return addr >= PROGRAM_START_OFFSET && addr + 1 < image_end;
+}
+
+void mark_leader(unsigned addr) {
+    if (addr < sizeof(leader)) leader[addr] = true;
+}
+
+// Recursive disassembly from the program start, marking reachable instructions and block leaders.
+void discover() {
+    static unsigned worklist[2 * 4096];
+    unsigned pending = 0;
+
+    worklist[pending++] = PROGRAM_START_OFFSET;
+    mark_leader(PROGRAM_START_OFFSET);
+
+    while (pending > 0) {
+        unsigned addr = worklist[--pending];
+        if (!in_image(addr) || reachable[addr]) continue;
+        reachable[addr] = true;
+
+        word code = fetch(addr);
+        unsigned nnn = code.WORD & 0xFFF;
+        unsigned next[2];
+        unsigned count = 0;
+
+        switch (classify(code)) {
+            case OP_FALLBACK:
+            case OP_RETURN:
+                break;
+            case OP_STRAIGHT:
+                next[count++] = addr + 2;
+                break;
+            case OP_STORE:
+            case OP_CALLOUT:
+                mark_leader(addr + 2);
+                next[count++] = addr + 2;
+                break;
+            case OP_SKIP:
+                mark_leader(addr + 2);
+                mark_leader(addr + 4);
+                next[count++] = addr + 2;
+                next[count++] = addr + 4;
+                break;
+            case OP_JUMP:
+                mark_leader(nnn);
+                next[count++] = nnn;
+                break;
+            case OP_CALL:
+                // the return lands on the instruction after the call
+                mark_leader(nnn);
+                mark_leader(addr + 2);
+                next[count++] = nnn;
+                next[count++] = addr + 2;
+                break;
+        }
+        for (unsigned i = 0; i < count; ++i)
+            if (next[i] < sizeof(image)) worklist[pending++] = next[i];
+    }
+}
+
+// Emits the C statements for one instruction. Returns true if the instruction ends the block.
+bool emit_instruction(FILE *out, unsigned addr, unsigned steps) {
+    word code = fetch(addr);
+    unsigned nnn = code.WORD & 0xFFF;
+    byte kk = code.BYTE.low;
+    byte x = (code.WORD & 0x0F00) >> 8;
+    byte y = (code.WORD & 0x00F0) >> 4;
+    byte n = (code.WORD & 0x000F);
+
+    fprintf(out, "    // 0x%03x: %04x\n", addr, code.WORD);
+
+    // Semantics below mirror the functions in cpu.c, statement order included, so results are identical
+    // to the interpreter (also when x or y is VF).
+    switch (code.WORD >> 12) {
+        case 0x0:
+            if (code.WORD == 0x00E0) {
+                fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    clear_display();\n    return %u;\n", addr, steps);
+                return true;
+            }
+            fprintf(out, "    cpu.pc.WORD = cpu.stack[cpu.sp.WORD].WORD + 2;\n    cpu.sp.WORD--;\n");
+            fprintf(out, "    return %u;\n", steps);
+            return true;
+        case 0x1:
+            fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    return %u;\n", nnn, steps);
+            return true;
+        case 0x2:
+            fprintf(out, "    cpu.sp.WORD++;\n    cpu.stack[cpu.sp.WORD].WORD = 0x%03x;\n", addr);
+            fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    return %u;\n", nnn, steps);
+            return true;
+        case 0x3:
+            fprintf(out, "    cpu.pc.WORD = cpu.v[0x%x] == 0x%02x ? 0x%03x : 0x%03x;\n", x, kk, addr + 4, addr + 2);
+            fprintf(out, "    return %u;\n", steps);
+            return true;
+        case 0x4:
+            fprintf(out, "    cpu.pc.WORD = cpu.v[0x%x] != 0x%02x ? 0x%03x : 0x%03x;\n", x, kk, addr + 4, addr + 2);
+            fprintf(out, "    return %u;\n", steps);
+            return true;
+        case 0x5:
+            fprintf(out, "    cpu.pc.WORD = cpu.v[0x%x] == cpu.v[0x%x] ? 0x%03x : 0x%03x;\n", x, y, addr + 4, addr + 2);
+            fprintf(out, "    return %u;\n", steps);
+            return true;
+        case 0x6:
+            fprintf(out, "    cpu.v[0x%x] = 0x%02x;\n", x, kk);
+            return false;
+        case 0x7:
+            fprintf(out, "    cpu.v[0x%x] += 0x%02x;\n", x, kk);
+            return false;
+        case 0x8:
+            switch (n) {
+                case 0x0: fprintf(out, "    cpu.v[0x%x] = cpu.v[0x%x];\n", x, y); break;
+                case 0x1: fprintf(out, "    cpu.v[0x%x] |= cpu.v[0x%x];\n", x, y); break;
+                case 0x2: fprintf(out, "    cpu.v[0x%x] &= cpu.v[0x%x];\n", x, y); break;
+                case 0x3: fprintf(out, "    cpu.v[0x%x] ^= cpu.v[0x%x];\n", x, y); break;
+                case 0x4:
+                    fprintf(out, "    { int sum = cpu.v[0x%x] + cpu.v[0x%x];\n", x, y);
+                    fprintf(out, "      cpu.v[0xf] = sum > 255;\n      cpu.v[0x%x] = sum; }\n", x);
+                    break;
+                case 0x5:
+                    fprintf(out, "    cpu.v[0xf] = cpu.v[0x%x] > cpu.v[0x%x];\n", x, y);
+                    fprintf(out, "    cpu.v[0x%x] -= cpu.v[0x%x];\n", x, y);
+                    break;
+                case 0x6:
+                    fprintf(out, "    cpu.v[0xf] = cpu.v[0x%x] & 0x01;\n", y);
+                    fprintf(out, "    cpu.v[0x%x] = cpu.v[0x%x] >> 1;\n", x, y);
+                    break;
+                case 0x7:
+                    fprintf(out, "    cpu.v[0xf] = cpu.v[0x%x] > cpu.v[0x%x];\n", y, x);
+                    fprintf(out, "    cpu.v[0x%x] = cpu.v[0x%x] - cpu.v[0x%x];\n", x, y, x);
+                    break;
+                case 0xE:
+                    fprintf(out, "    cpu.v[0xf] = cpu.v[0x%x] & 0x01;\n", y);
+                    fprintf(out, "    cpu.v[0x%x] = cpu.v[0x%x] << 1;\n", x, y);
+                    break;
+            }
+            return false;
+        case 0x9:
+            fprintf(out, "    cpu.pc.WORD = cpu.v[0x%x] != cpu.v[0x%x] ? 0x%03x : 0x%03x;\n", x, y, addr + 4, addr + 2);
+            fprintf(out, "    return %u;\n", steps);
+            return true;
+        case 0xA:
+            fprintf(out, "    cpu.i.WORD = 0x%03x;\n", nnn);
+            return false;
+        case 0xC:
+            fprintf(out, "    cpu.v[0x%x] = random_byte() & 0x%02x;\n", x, kk);
+            return false;
+        case 0xD:
+            fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    draw(0x%x, 0x%x, 0x%x);\n    return %u;\n", addr, x, y, n, steps);
+            return true;
+        case 0xE:
+            fprintf(out, "    cpu.pc.WORD = %sisKeyPressed(cpu.v[0x%x]) ? 0x%03x : 0x%03x;\n",
+                    kk == 0x9E ? "" : "!", x, addr + 4, addr + 2);
+            fprintf(out, "    return %u;\n", steps);
+            return true;
+        case 0xF:
+            switch (kk) {
+                case 0x07: fprintf(out, "    cpu.v[0x%x] = cpu.dt;\n", x); return false;
+                case 0x15: fprintf(out, "    cpu.dt = cpu.v[0x%x];\n", x); return false;
+                case 0x18: fprintf(out, "    cpu.st = cpu.v[0x%x];\n", x); return false;
+                case 0x1E: fprintf(out, "    cpu.i.WORD += cpu.v[0x%x];\n", x); return false;
+                case 0x29: fprintf(out, "    cpu.i.WORD = cpu.v[0x%x] * 5;\n", x); return false;
+                case 0x65:
+                    fprintf(out, "    for (unsigned r = 0; r <= 0x%x; ++r) cpu.v[r] = memory[cpu.i.WORD + r];\n", x);
+                    fprintf(out, "    cpu.i.WORD += 0x%x;\n", x + 1);
+                    return false;
+                case 0x33:
+                    fprintf(out, "    memory[cpu.i.WORD] = cpu.v[0x%x] / 100;\n", x);
+                    fprintf(out, "    memory[cpu.i.WORD+1] = (cpu.v[0x%x] %% 100) / 10;\n", x);
+                    fprintf(out, "    memory[cpu.i.WORD+2] = cpu.v[0x%x] %% 10;\n", x);
+                    fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    return %u;\n", addr + 2, steps);
+                    return true;
+                case 0x55:
+                    fprintf(out, "    for (unsigned r = 0; r <= 0x%x; ++r) memory[cpu.i.WORD + r] = cpu.v[r];\n", x);
+                    fprintf(out, "    cpu.i.WORD += 0x%x;\n", x + 1);
+                    fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    return %u;\n", addr + 2, steps);
+                    return true;
+                case 0x0A:
+                    fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    load_key(0x%x);\n    return %u;\n", addr, x, steps);
+                    return true;
+            }
+    }
+    return true;
+}
+
+// Length in bytes of the block starting at addr.
+unsigned block_length(unsigned addr) {
+    unsigned start = addr;
+    for (;;) {
+        opkind kind = classify(fetch(addr));
+        addr += 2;
+        if (kind != OP_STRAIGHT) break;
+        if (!in_image(addr) || leader[addr] || !reachable[addr] || classify(fetch(addr)) == OP_FALLBACK) break;
+    }
+    return addr - start;
+}
+
+void emit_block(FILE *out, unsigned start) {
+    unsigned length = block_length(start);
+    unsigned end = start + length;
+
+    fprintf(out, "static unsigned block_%03x(unsigned budget) {\n", start);
+    fprintf(out, "    if (budget < %u || memcmp(memory + 0x%03x, rom + 0x%03x, %u) != 0) return 0;\n\n",
+            length / 2, start, start - PROGRAM_START_OFFSET, length);
+
+    unsigned steps = 0;
+    for (unsigned addr = start; addr < end; addr += 2)
+        if (emit_instruction(out, addr, ++steps)) break;
+
+    if (classify(fetch(end - 2)) == OP_STRAIGHT)
+        fprintf(out, "    cpu.pc.WORD = 0x%03x;\n    return %u;\n", end, steps);
+    fprintf(out, "}\n\n");
+}
+
+bool compiled(unsigned addr) {
+    return leader[addr] && reachable[addr] && classify(fetch(addr)) != OP_FALLBACK;
+}
+
+int recompile(const char *name, FILE *out) {
+    unsigned blocks = 0;
+
+    fprintf(out, "// Generated by chip8rc from %s. Do not edit.\n\n", name);
+    fprintf(out, "#include \"machine.h\"\n\n#include <string.h>\n\n");
+
+    fprintf(out, "static const byte rom[%u] = {", image_end - PROGRAM_START_OFFSET);
+    for (unsigned addr = PROGRAM_START_OFFSET; addr < image_end; ++addr) {
+        if ((addr - PROGRAM_START_OFFSET) % 16 == 0) fprintf(out, "\n   ");
+        fprintf(out, " 0x%02x,", image[addr]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    for (unsigned addr = 0; addr < sizeof(image); ++addr) {
+        if (!compiled(addr)) continue;
+        emit_block(out, addr);
+        blocks++;
+    }
+
+    fprintf(out, "unsigned aot_execute(unsigned budget) {\n    switch (cpu.pc.WORD) {\n");
+    for (unsigned addr = 0; addr < sizeof(image); ++addr)
+        if (compiled(addr)) fprintf(out, "        case 0x%03x: return block_%03x(budget);\n", addr, addr);
+    fprintf(out, "    }\n    return 0;\n}\n");
+
+    INFO("%u blocks recompiled from %s\n", blocks, name);
+    return 0;
+}
+
+int load_image(const char *file) {
+    const unsigned max_size = sizeof(image) - PROGRAM_START_OFFSET;
+
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        ERR("Couldn't open %s (%s)\n", file, strerror(errno));
+        return 1;
+    }
+    unsigned size = fread(image + PROGRAM_START_OFFSET, 1, max_size, f);
+    bool too_large = fgetc(f) != EOF;
+    fclose(f);
+
+    if (too_large) {
+        ERR("File size exceeds %u bytes. Can't load into memory.\n", max_size);
+        return 1;
+    }
+    image_end = PROGRAM_START_OFFSET + size;
+    LOG("%s: %u bytes\n", file, size);
+    return 0;
+}
+
+int main(const int argc, char **argv) {
+    int helpflag = 0;
+    const char *output = NULL;
+
+    int opt;
+    extern char *optarg;
+    extern int optind, optopt;
+    while ((opt = getopt(argc, argv, "ho:v:")) != -1) {
+        switch (opt) {
+        case 'h':
+            helpflag++;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'v':
+            verbosity = atoi(optarg);
+            break;
+        case '?':
+            ERR("Unrecognized option: '-%c'\n", optopt);
+            helpflag++;
+        }
+    }
+
+    if(argv[optind] == NULL) {
+        ERR("Mandatory argument missing.\n");
+        helpflag++;
+    }
+
+    if(helpflag) {
+        const char *helpstr =
+          "usage: %s [options] rom\n"
+          "options:\n"
+          "  -o [file]  Writes the generated C to file (default stdout).\n"
+          "  -v [lvl]   Sets the verbosity level (default 1).\n"
+          "  -h         Displays help.\n";
+        printf(helpstr, argv[0]);
+        return 2;
+    }
+
+    if (load_image(argv[optind]) > 0) return 1;
+    discover();
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        ERR("Couldn't open %s (%s)\n", output, strerror(errno));
+        return 1;
+    }
+    int status = recompile(argv[optind], out);
+    if (out != stdout) fclose(out);
+    return status;
+}
@@ -0,0 +1,270 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#include "telemetry.h"
+
+#include <pthread.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Macro for verbose printing. 0 = no prints, 1 = only info, etc.
+unsigned char telemetry_verbosity;
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define INFO(...) if(telemetry_verbosity > 0) printf(__VA_ARGS__)
+#define LOG(...) if(telemetry_verbosity > 1) printf(__VA_ARGS__)
+
+// The run loop is the only writer, so relaxed loads and stores are enough to publish counters to the
+// exporter thread; no locks or read-modify-write on the hot path.
+#define STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELAXED)
+#define LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define BUMP(var, n) STORE(var, LOAD(var) + (n))
+
+#define BUCKETS 12
+// Upper bounds in seconds; the last bucket is +Inf.
+static const double bucket_bounds[BUCKETS - 1] = {
+        0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.0167, 0.025, 0.05, 0.1
+};
+
+typedef struct {
+    unsigned long long buckets[BUCKETS];    // not cumulative; summed when exported
+    unsigned long long sum;                 // nanoseconds
+} histogram;
+
+bool telemetry_enabled;
+
+// Written by the run loop.
+unsigned long long instructions_total;
+unsigned long long frames_total;
+unsigned long long sleep_total;         // nanoseconds
+long long timer_drift;                  // nanoseconds behind (positive) or ahead of the 60 Hz timer
+histogram frame_time;
+histogram render_time;
+unsigned long long first_frame;
+
+// Exporter thread state.
+const char *socket_path;
+int listen_fd = -1;
+int stop_pipe[2];
+pthread_t exporter;
+double instructions_per_second, frames_per_second;
+
+unsigned long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void observe(histogram *h, unsigned long long ns) {
+    unsigned b = 0;
+    while(b < BUCKETS - 1 && ns > bucket_bounds[b] * 1e9) b++;
+    BUMP(h->buckets[b], 1);
+    BUMP(h->sum, ns);
+}
+
+// Run loop hooks ----------------------------------------------------------------------------------------------------
+
+unsigned long long telemetry_clock() {
+    return telemetry_enabled ? monotonic_ns() : 0;
+}
+
+void telemetry_render(unsigned long long start) {
+    if(!telemetry_enabled) return;
+    observe(&render_time, monotonic_ns() - start);
+}
+
+void telemetry_sleep(unsigned long long start) {
+    if(!telemetry_enabled) return;
+    BUMP(sleep_total, monotonic_ns() - start);
+}
+
+void telemetry_frame(unsigned long long start, unsigned instructions) {
+    if(!telemetry_enabled) return;
+    unsigned long long now = monotonic_ns();
+
+    if(first_frame == 0) first_frame = start;
+    unsigned long long frames = LOAD(frames_total) + 1;
+    STORE(frames_total, frames);
+    BUMP(instructions_total, instructions);
+    observe(&frame_time, now - start);
+
+    // the delay and sound timers tick once per cycle, and should tick at 60 Hz
+    STORE(timer_drift, (long long)(now - first_frame) - (long long)(frames * 1000000000ULL / 60));
+}
+
+// Exporter ----------------------------------------------------------------------------------------------------------
+
+// Formats onto the end of out, returning the new length.
+int append(char *out, int used, int size, const char *format, ...) {
+    if(used >= size) return used;
+    va_list args;
+    va_start(args, format);
+    used += vsnprintf(out + used, size - used, format, args);
+    va_end(args);
+    return used;
+}
+
+int append_histogram(char *out, int used, int size, const char *name, const char *help, histogram *h) {
+    used = append(out, used, size, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    unsigned long long cumulative = 0;
+    for(unsigned b = 0; b < BUCKETS; ++b) {
+        cumulative += LOAD(h->buckets[b]);
+        if(b < BUCKETS - 1) used = append(out, used, size, "%s_bucket{le=\"%g\"} %llu\n", name, bucket_bounds[b], cumulative);
+        else used = append(out, used, size, "%s_bucket{le=\"+Inf\"} %llu\n", name, cumulative);
+    }
+    used = append(out, used, size, "%s_sum %.9f\n%s_count %llu\n", name, LOAD(h->sum) / 1e9, name, cumulative);
+    return used;
+}
+
+int format_metrics(char *out, int size) {
+    int used = 0;
+    used = append(out, used, size,
+            "# HELP chip8_instructions_total Instructions executed.\n# TYPE chip8_instructions_total counter\n"
+            "chip8_instructions_total %llu\n", LOAD(instructions_total));
+    used = append(out, used, size,
+            "# HELP chip8_frames_total Emulated frames (60 Hz timer ticks).\n# TYPE chip8_frames_total counter\n"
+            "chip8_frames_total %llu\n", LOAD(frames_total));
+    used = append(out, used, size,
+            "# HELP chip8_instructions_per_second Instructions executed per second.\n"
+            "# TYPE chip8_instructions_per_second gauge\nchip8_instructions_per_second %.1f\n",
+            instructions_per_second);
+    used = append(out, used, size,
+            "# HELP chip8_frames_per_second Emulated frames per second.\n"
+            "# TYPE chip8_frames_per_second gauge\nchip8_frames_per_second %.2f\n", frames_per_second);
+    used = append(out, used, size,
+            "# HELP chip8_sleep_seconds_total Time the run loop spent sleeping.\n"
+            "# TYPE chip8_sleep_seconds_total counter\nchip8_sleep_seconds_total %.9f\n", LOAD(sleep_total) / 1e9);
+    used = append(out, used, size,
+            "# HELP chip8_timer_drift_seconds Wall time minus emulated 60 Hz timer time; positive is behind.\n"
+            "# TYPE chip8_timer_drift_seconds gauge\nchip8_timer_drift_seconds %.6f\n", LOAD(timer_drift) / 1e9);
+    used = append_histogram(out, used, size, "chip8_frame_seconds", "Wall time per emulated frame.", &frame_time);
+    used = append_histogram(out, used, size, "chip8_render_seconds", "Time spent in render_buffer and present.",
+            &render_time);
+    return used < size ? used : size - 1;
+}
+
+// Serves one scrape. Any request gets the metrics; the request itself is read and ignored.
+void serve(int fd) {
+    static char body[8192];
+    char response[8192 + 256];
+
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char request[1024];
+    int received = 0;
+    while(received < (int)sizeof(request) - 1) {
+        int n = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+        if(n <= 0) break;
+        received += n;
+        request[received] = '\0';
+        if(strstr(request, "\r\n\r\n") != NULL) break;
+    }
+
+    int length = format_metrics(body, sizeof(body));
+    int total = snprintf(response, sizeof(response),
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n%s",
+            length, body);
+    for(int sent = 0; sent < total; ) {
+        int n = send(fd, response + sent, total - sent, MSG_NOSIGNAL);
+        if(n <= 0) break;
+        sent += n;
+    }
+    close(fd);
+}
+
+void sample_rates(unsigned long long *last_time, unsigned long long *last_instructions,
+                  unsigned long long *last_frames) {
+    unsigned long long now = monotonic_ns();
+    unsigned long long instructions = LOAD(instructions_total);
+    unsigned long long frames = LOAD(frames_total);
+    double seconds = (now - *last_time) / 1e9;
+
+    instructions_per_second = (instructions - *last_instructions) / seconds;
+    frames_per_second = (frames - *last_frames) / seconds;
+    *last_time = now;
+    *last_instructions = instructions;
+    *last_frames = frames;
+}
+
+void *exporter_main(void *arg) {
+    unsigned long long last_time = monotonic_ns();
+    unsigned long long last_instructions = 0, last_frames = 0;
+    unsigned long long interval = TELEMETRY_SAMPLE_INTERVAL * 1000000ULL;
+
+    for(;;) {
+        struct pollfd fds[2] = { { listen_fd, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+        unsigned long long elapsed = monotonic_ns() - last_time;
+        int wait = elapsed >= interval ? 0 : (int)((interval - elapsed) / 1000000);
+
+        if(poll(fds, 2, wait) < 0 && errno != EINTR) break;
+        if(fds[1].revents) break;
+        if(monotonic_ns() - last_time >= interval) sample_rates(&last_time, &last_instructions, &last_frames);
+        if(fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if(fd >= 0) serve(fd);
+        }
+    }
+    return NULL;
+}
+
+// Removes a stale socket left at path, but never anything else. Returns false if path is something else.
+bool remove_stale_socket(const char *path) {
+    struct stat st;
+    if(lstat(path, &st) != 0) return errno == ENOENT;
+    if(!S_ISSOCK(st.st_mode)) return false;
+    unlink(path);
+    return true;
+}
+
+int telemetry_open(const char *path, unsigned char verbose_lvl) {
+    telemetry_verbosity = verbose_lvl;
+    socket_path = path;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        ERR("Telemetry socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if(!remove_stale_socket(path)) {
+        ERR("Couldn't listen on %s (exists and is not a socket)\n", path);
+        return 1;
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 4) != 0) {
+        ERR("Couldn't listen on %s (%s)\n", path, strerror(errno));
+        return 1;
+    }
+    if(pipe(stop_pipe) != 0 || pthread_create(&exporter, NULL, exporter_main, NULL) != 0) {
+        ERR("Couldn't start telemetry exporter thread\n");
+        return 1;
+    }
+
+    telemetry_enabled = true;
+    INFO("Serving telemetry on %s\n", path);
+    return 0;
+}
+
+void telemetry_close() {
+    if(!telemetry_enabled) return;
+    telemetry_enabled = false;
+
+    write(stop_pipe[1], "", 1);
+    pthread_join(exporter, NULL);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    close(listen_fd);
+    remove_stale_socket(socket_path);
+}
@@ -0,0 +1,23 @@
+//
+// Created by olle on 2026-10-19.
+//
+
+#ifndef CHIP8_TELEMETRY_H
+#define CHIP8_TELEMETRY_H
+
+// How often the exporter samples the counters for the per-second gauges, in milliseconds.
+static unsigned const TELEMETRY_SAMPLE_INTERVAL = 1000;
+
+// Starts serving run loop metrics in Prometheus text format on a Unix socket at path, e.g.
+//   curl --unix-socket /tmp/chip8.sock http://localhost/metrics
+int telemetry_open(const char *path, unsigned char verbose_lvl);
+void telemetry_close();
+
+// Run loop hooks. Only the run loop thread calls these; they do nothing (and read no clock) when telemetry
+// is off. Times are monotonic nanoseconds from telemetry_clock().
+unsigned long long telemetry_clock();
+void telemetry_render(unsigned long long start);    // render_buffer(), including present/vsync
+void telemetry_sleep(unsigned long long start);     // time spent in SDL_Delay
+void telemetry_frame(unsigned long long start, unsigned instructions);  // end of a cycle (one 60 Hz tick)
+
+#endif //CHIP8_TELEMETRY_H
@@ -0,0 +1,307 @@
+//
+// Created by olle on 2026-10-19.
+//
+// chip8-term: runs a rom in a terminal, e.g. over SSH where SDL is unavailable.
+//
+// The screen is drawn with half-block characters, two pixel rows per character cell, so 64x32 pixels take
+// 64x16 cells. The terminal keeps what was drawn, so each frame only sends the cells that changed since the
+// previous one, all batched into a single write(). Keys are read from stdin in raw mode.
+//
+
+#include "machine.h"
+#include "emulator.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+unsigned char term_verbosity = 1;
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define INFO(...) if(term_verbosity > 0) printf(__VA_ARGS__)
+
+#define COLUMNS 64
+#define ROWS 16                 // character rows; each is two pixel rows
+#define UNKNOWN 0xFF            // a cell or cursor position the terminal may not show as we think
+
+// Terminals only report key presses, not releases. A pressed key is held for a while; a held key repeats
+// after the terminal's autorepeat delay (about 500 ms), and then every few frames.
+static unsigned const KEY_HOLD = 32;            // frames a new press is held
+static unsigned const KEY_REPEAT_HOLD = 6;      // frames a repeated press is held
+
+// Cell contents: bit 0 is the upper pixel, bit 1 the lower.
+static const char *const glyphs[4] = { " ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88" };   // " ▀ ▄ █"
+static const unsigned glyph_length[4] = { 1, 3, 3, 3 };
+
+// Host key for each chip8 key, as in the SDL frontend.
+static const char keymap[16] = {
+        'x', '1', '2', '3',     // 0 1 2 3
+        'q', 'w', 'e', 'a',     // 4 5 6 7
+        's', 'd', 'z', 'c',     // 8 9 A B
+        '4', 'r', 'f', 'v'      // C D E F
+};
+
+struct termios original_termios;
+bool raw_mode;
+
+byte shown[ROWS][COLUMNS];      // what the terminal displays, or UNKNOWN
+unsigned cursor_row = UNKNOWN, cursor_column = UNKNOWN;
+bool colors_set;
+unsigned key_hold[16];
+
+volatile sig_atomic_t resized, stopped;
+
+// One frame of output. Every cell changing, each with a cursor move, fits with room to spare.
+char out[ROWS * COLUMNS * 16 + 256];
+unsigned out_length;
+unsigned long long bytes_written;
+
+// Terminal ----------------------------------------------------------------------------------------------------------
+
+void restore_terminal() {
+    if(!raw_mode) return;
+    raw_mode = false;
+    // reset colors, show the cursor, leave the alternate screen
+    static const char reset[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+    write(STDOUT_FILENO, reset, sizeof(reset) - 1);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
+}
+
+void on_signal(int signal) {
+    if(signal == SIGWINCH) resized = 1;
+    else stopped = 1;
+}
+
+int open_terminal() {
+    if(!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        ERR("chip8-term needs a terminal on stdin and stdout\n");
+        return 1;
+    }
+    struct winsize size;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && (size.ws_col < COLUMNS || size.ws_row < ROWS))
+        ERR("Terminal is %ux%u; the screen needs %ux%u\n", size.ws_col, size.ws_row, COLUMNS, ROWS);
+
+    // no echo, no line buffering, no signal keys; reads return at once with whatever is there
+    tcgetattr(STDIN_FILENO, &original_termios);
+    struct termios raw = original_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cflag |= CS8;
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        ERR("Couldn't put the terminal in raw mode\n");
+        return 1;
+    }
+    raw_mode = true;
+    atexit(restore_terminal);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGWINCH, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+
+    // alternate screen, hidden cursor; the first frame draws every cell
+    static const char setup[] = "\x1b[?1049h\x1b[?25l";
+    write(STDOUT_FILENO, setup, sizeof(setup) - 1);
+    memset(shown, UNKNOWN, sizeof(shown));
+    return 0;
+}
+
+// Rendering ---------------------------------------------------------------------------------------------------------
+
+void emit(const char *data, unsigned length) {
+    memcpy(out + out_length, data, length);
+    out_length += length;
+}
+
+unsigned digits(unsigned n) {
+    return n >= 100 ? 3 : n >= 10 ? 2 : 1;
+}
+
+// Moves the cursor to a cell with the fewest bytes: reprinting the cells in between, a cursor forward, or an
+// absolute position.
+void move_cursor(unsigned row, unsigned column) {
+    if(row == cursor_row && column == cursor_column) return;
+
+    if(row == cursor_row && column > cursor_column) {
+        unsigned gap = column - cursor_column;
+        unsigned reprint = 0;
+        for(unsigned c = cursor_column; c < column; ++c) reprint += glyph_length[shown[row][c]];
+        if(reprint <= 3 + digits(gap)) {
+            for(unsigned c = cursor_column; c < column; ++c) emit(glyphs[shown[row][c]], glyph_length[shown[row][c]]);
+        } else {
+            out_length += sprintf(out + out_length, "\x1b[%uC", gap);
+        }
+        return;
+    }
+    out_length += sprintf(out + out_length, "\x1b[%u;%uH", row + 1, column + 1);
+}
+
+void render_frame() {
+    if(resized) {
+        // the terminal may have reflowed or cleared the screen; this is the only time everything is redrawn
+        resized = 0;
+        memset(shown, UNKNOWN, sizeof(shown));
+        cursor_row = UNKNOWN;
+        colors_set = false;
+    }
+
+    out_length = 0;
+    for(unsigned row = 0; row < ROWS; ++row) {
+        for(unsigned column = 0; column < COLUMNS; ++column) {
+            byte cell = screen_buffer[(2 * row) * 64 + column] | screen_buffer[(2 * row + 1) * 64 + column] << 1;
+            if(cell == shown[row][column]) continue;
+
+            if(!colors_set) {
+                // nothing else changes the colors, so they're set once
+                colors_set = true;
+                out_length += sprintf(out + out_length, "\x1b[38;2;%u;%u;%u;48;2;%u;%u;%um",
+                                      FG_R, FG_G, FG_B, BG_R, BG_G, BG_B);
+            }
+            move_cursor(row, column);
+            emit(glyphs[cell], glyph_length[cell]);
+            shown[row][column] = cell;
+
+            // after the last column, terminals differ in where the cursor is
+            cursor_row = column + 1 < COLUMNS ? row : UNKNOWN;
+            cursor_column = column + 1;
+        }
+    }
+
+    for(unsigned written = 0; written < out_length; ) {
+        int n = write(STDOUT_FILENO, out + written, out_length - written);
+        if(n <= 0) break;
+        written += n;
+    }
+    bytes_written += out_length;
+    cpu.need_repaint = false;
+}
+
+// Input -------------------------------------------------------------------------------------------------------------
+
+void press(char c) {
+    if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    for(byte k = 0; k < 16; ++k) {
+        if(keymap[k] != c) continue;
+        key_hold[k] = key_hold[k] > 0 ? KEY_REPEAT_HOLD : KEY_HOLD;
+    }
+}
+
+// Reads the keys pressed since the last frame, and returns the keys held this frame.
+unsigned short read_input() {
+    char input[64];
+    int length;
+    while((length = read(STDIN_FILENO, input, sizeof(input))) > 0) {
+        for(int i = 0; i < length; ++i) {
+            if(input[i] == 3) {
+                stopped = 1;                    // ctrl-c
+            } else if(input[i] == 27) {
+                if(i + 1 == length) {
+                    stopped = 1;                // a lone escape
+                } else if(input[i + 1] == '[' || input[i + 1] == 'O') {
+                    // skip escape sequences (arrow keys etc.) up to their final byte
+                    for(i += 2; i < length && !(input[i] >= 0x40 && input[i] <= 0x7E); ++i);
+                }
+            } else {
+                press(input[i]);
+            }
+        }
+    }
+
+    unsigned short keys = 0;
+    for(byte k = 0; k < 16; ++k) {
+        if(key_hold[k] == 0) continue;
+        keys |= 1 << k;
+        key_hold[k]--;
+    }
+    return keys;
+}
+
+// Run loop ----------------------------------------------------------------------------------------------------------
+
+unsigned long run_terminal(unsigned long frame_limit) {
+    const long long tick = 1000000000LL / 60;
+    struct timespec next_tick;
+    clock_gettime(CLOCK_MONOTONIC, &next_tick);
+
+    unsigned long frames = 0;
+    while(cpu.running && !stopped) {
+        cpu.keypad = read_input();
+        emulate_frame();
+        if(cpu.need_repaint || resized) render_frame();
+        if(frame_limit && ++frames >= frame_limit) break;
+
+        next_tick.tv_nsec += tick;
+        if(next_tick.tv_nsec >= 1000000000L) {
+            next_tick.tv_sec++;
+            next_tick.tv_nsec -= 1000000000L;
+        }
+        // don't try to catch up after a long stall
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(now.tv_sec > next_tick.tv_sec + 1) next_tick = now;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
+    }
+    return frames;
+}
+
+int main(const int argc, char **argv) {
+    int helpflag = 0;
+    unsigned long frame_limit = 0;
+
+    int opt;
+    extern char *optarg;
+    extern int optind, optopt;
+    while ((opt = getopt(argc, argv, "hv:n:")) != -1) {
+        switch (opt) {
+        case 'h':
+            helpflag++;
+            break;
+        case 'v':
+            term_verbosity = atoi(optarg);
+            break;
+        case 'n':
+            frame_limit = strtoul(optarg, NULL, 10);
+            break;
+        case '?':
+            ERR("Unrecognized option: '-%c'\n", optopt);
+            helpflag++;
+        }
+    }
+
+    if(argv[optind] == NULL) {
+        ERR("Mandatory argument missing.\n");
+        helpflag++;
+    }
+
+    if(helpflag) {
+        const char *helpstr =
+          "usage: %s [options] rom\n"
+          "options:\n"
+          "  -v [lvl]   Sets the verbosity level (default 1).\n"
+          "  -n [num]   Stops after num frames.\n"
+          "  -h         Displays help.\n"
+          "keys: 1234/qwer/asdf/zxcv as on the chip8 keypad; escape or ctrl-c quits.\n";
+        printf(helpstr, argv[0]);
+        return 2;
+    }
+
+    initialize_machine(term_verbosity);
+    if(load_rom(argv[optind]) > 0) return 1;
+    initialize_cpu(term_verbosity);
+
+    if(open_terminal() > 0) return 1;
+    unsigned long frames = run_terminal(frame_limit);
+    restore_terminal();
+
+    INFO("%lu frames, %llu bytes of output (%.1f per frame)\n", frames, bytes_written,
+         frames ? (double)bytes_written / frames : 0.0);
+    return 0;
+}